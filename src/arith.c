@@ -30,6 +30,7 @@
 #include <wchar.h>
 #include <sys/types.h>
 #include <wctype.h>
+#include "hashtable.h"
 #include "option.h"
 #include "strbuf.h"
 #include "util.h"
@@ -82,15 +83,67 @@ typedef struct evalinfo_T {
     size_t index;        /* index of next token */
     atoken_T atoken;     /* current token */
     bool parseonly;      /* only parse the expression: don't calculate */
+    bool quiet;          /* don't print an error message on invalid token */
     bool error;          /* true if there is an error */
     char *savelocale;    /* original LC_NUMERIC locale */
 } evalinfo_T;
 
+/* An arithmetic expression can be compiled into a sequence of instructions for
+ * a simple stack machine, which is cached and re-executed without parsing the
+ * expression again. Each instruction operates on the `value_T's at the top of
+ * the stack. */
+typedef enum opcode_T {
+    OP_PUSH,        /* push `value' */
+    OP_BINARY,      /* pop two values and push the result of `ttype' */
+    OP_COMPARE,     /* pop two values and push the result of comparison */
+    OP_ASSIGN,      /* pop two values and assign the top to the other */
+    OP_UNARY,       /* apply the prefix "+", "-", "~" or "!" to the top */
+    OP_INCREMENT,   /* apply the prefix "++" or "--" to the top */
+    OP_POSTINCREMENT, /* apply the postfix "++" or "--" to the top */
+    OP_OR,          /* jump to `target' if the top is true, or pop it */
+    OP_AND,         /* jump to `target' if the top is false, or pop it */
+    OP_BOOL,        /* convert the top into 0 or 1 */
+    OP_CONDITION,   /* pop the top and jump to `target' if it is false */
+    OP_JUMP,        /* jump to `target' */
+} opcode_T;
+typedef struct instr_T {
+    opcode_T opcode;
+    atokentype_T ttype;  /* operator */
+    value_T value;       /* valid only for OP_PUSH */
+    size_t target;       /* valid only for jumping instructions */
+    size_t endtarget;    /* valid only for OP_CONDITION */
+} instr_T;
+/* For OP_OR, OP_AND, and OP_CONDITION, if the top is invalid, it is left on
+ * the stack and execution jumps to `target' (`endtarget' for OP_CONDITION) so
+ * that the operands that would not be evaluated are skipped. */
+
+typedef struct arithprog_T {
+    wchar_t *exp;         /* copy of the source; VT_VAR values point into it */
+    instr_T *code;
+    size_t length;        /* number of instructions in `code' */
+    size_t maxdepth;      /* stack depth needed to execute `code' */
+    bool posix;           /* value of `posixly_correct' when compiled */
+    unsigned long gen;    /* value of `locale_generation' when compiled */
+} arithprog_T;
+
+typedef struct compinfo_T {
+    evalinfo_T eval;      /* state of the tokenizer */
+    arithprog_T *prog;    /* program being compiled */
+    size_t capacity;      /* allocated length of `prog->code' */
+    size_t depth;         /* stack depth at the current instruction */
+} compinfo_T;
+
+/* The maximum number of compiled expressions kept in the cache */
+#define ARITH_CACHE_MAX 256
+
 static void evaluate(
 	const wchar_t *exp, value_T *result, evalinfo_T *info, bool coerce)
     __attribute__((nonnull));
 static void parse_assignment(evalinfo_T *info, value_T *result)
     __attribute__((nonnull));
+static void do_assignment_operator(
+	evalinfo_T *info, atokentype_T ttype, value_T *lhs, value_T *rhs)
+    __attribute__((nonnull));
 static bool do_assignment(const word_T *word, const value_T *value)
     __attribute__((nonnull));
 static wchar_t *value_to_string(const value_T *value)
@@ -103,6 +156,9 @@ static long do_long_calculation1(atokentype_T ttype, long v1, long v2);
 static long do_long_calculation2(atokentype_T ttype, long v1, long v2);
 static double do_double_calculation(atokentype_T ttype, double v1, double v2);
 static long do_double_comparison(atokentype_T ttype, double v1, double v2);
+static void do_comparison(
+	evalinfo_T *info, atokentype_T ttype, value_T *lhs, value_T *rhs)
+    __attribute__((nonnull));
 static void parse_conditional(evalinfo_T *info, value_T *result)
     __attribute__((nonnull));
 static void parse_logical_or(evalinfo_T *info, value_T *result)
@@ -127,14 +183,26 @@ static void parse_multiplicative(evalinfo_T *info, value_T *result)
     __attribute__((nonnull));
 static void parse_prefix(evalinfo_T *info, value_T *result)
     __attribute__((nonnull));
+static void do_unary_calculation(
+	evalinfo_T *info, atokentype_T ttype, value_T *value)
+    __attribute__((nonnull));
+static void do_prefix_increment(
+	evalinfo_T *info, atokentype_T ttype, value_T *value)
+    __attribute__((nonnull));
 static void parse_postfix(evalinfo_T *info, value_T *result)
     __attribute__((nonnull));
+static void do_postfix_increment(
+	evalinfo_T *info, atokentype_T ttype, value_T *value)
+    __attribute__((nonnull));
 static void do_increment_or_decrement(atokentype_T ttype, value_T *value)
     __attribute__((nonnull));
 static void parse_primary(evalinfo_T *info, value_T *result)
     __attribute__((nonnull));
 static void parse_as_number(evalinfo_T *info, value_T *result)
     __attribute__((nonnull));
+static bool literal_to_number(
+	evalinfo_T *info, const wchar_t *literal, value_T *result)
+    __attribute__((nonnull,warn_unused_result));
 static void coerce_number(evalinfo_T *info, value_T *value)
     __attribute__((nonnull));
 static void coerce_integer(evalinfo_T *info, value_T *value)
@@ -147,6 +215,35 @@ static void next_token(evalinfo_T *info)
 static bool fail_if_will_divide_by_zero(
 	atokentype_T op, const value_T *rhs, evalinfo_T *info, value_T *result)
     __attribute__((nonnull));
+static const arithprog_T *get_compiled_expression(const wchar_t *exp)
+    __attribute__((nonnull));
+static void free_compiled_expression(kvpair_T kv);
+static arithprog_T *compile(const wchar_t *exp)
+    __attribute__((nonnull,malloc,warn_unused_result));
+static void free_arithprog(arithprog_T *prog)
+    __attribute__((nonnull));
+static size_t emit(compinfo_T *ci, opcode_T opcode, atokentype_T ttype)
+    __attribute__((nonnull));
+static void compile_assignment(compinfo_T *ci)
+    __attribute__((nonnull));
+static void compile_conditional(compinfo_T *ci)
+    __attribute__((nonnull));
+static void compile_logical_or(compinfo_T *ci)
+    __attribute__((nonnull));
+static void compile_logical_and(compinfo_T *ci)
+    __attribute__((nonnull));
+static int binary_precedence(atokentype_T ttype)
+    __attribute__((const));
+static void compile_binary(compinfo_T *ci, int precedence)
+    __attribute__((nonnull));
+static void compile_prefix(compinfo_T *ci)
+    __attribute__((nonnull));
+static void compile_postfix(compinfo_T *ci)
+    __attribute__((nonnull));
+static void compile_primary(compinfo_T *ci)
+    __attribute__((nonnull));
+static void execute(const arithprog_T *prog, value_T *result, evalinfo_T *info)
+    __attribute__((nonnull));
 
 
 /* Evaluates the specified string as an arithmetic expression.
@@ -217,21 +314,32 @@ bool evaluate_index(wchar_t *exp, ssize_t *valuep)
     return ok;
 }
 
+/* Evaluates the specified expression.
+ * If the expression has been compiled, the cached program is executed.
+ * Otherwise, the expression is parsed and calculated at the same time. */
 void evaluate(
 	const wchar_t *exp, value_T *result, evalinfo_T *info, bool coerce)
 {
-    info->exp = exp;
-    info->index = 0;
-    info->parseonly = false;
-    info->error = false;
-    info->savelocale = xstrdup(setlocale(LC_NUMERIC, NULL));
-
-    next_token(info);
-    parse_assignment(info, result);
+    const arithprog_T *prog = get_compiled_expression(exp);
+    if (prog != NULL) {
+	info->error = false;
+	info->atoken.type = TT_NULL;
+	execute(prog, result, info);
+    } else {
+	info->exp = exp;
+	info->index = 0;
+	info->parseonly = false;
+	info->quiet = false;
+	info->error = false;
+	info->savelocale = xstrdup(setlocale(LC_NUMERIC, NULL));
+
+	next_token(info);
+	parse_assignment(info, result);
+
+	free(info->savelocale);
+    }
     if (coerce)
 	coerce_number(info, result);
-
-    free(info->savelocale);
 }
 
 /* Parses an assignment expression.
@@ -251,20 +359,7 @@ void parse_assignment(evalinfo_T *info, value_T *result)
 		value_T rhs;
 		next_token(info);
 		parse_assignment(info, &rhs);
-		if (result->type == VT_VAR) {
-		    word_T saveword = result->v_var;
-		    if (!do_binary_calculation(
-				info, ttype, result, &rhs, result))
-			break;
-		    if (!do_assignment(&saveword, result))
-			info->error = true, result->type = VT_INVALID;
-		} else if (result->type != VT_INVALID) {
-		    /* TRANSLATORS: This error message is shown when the target
-		     * of an assignment is not a variable. */
-		    xerror(0, Ngt("arithmetic: cannot assign to a number"));
-		    info->error = true;
-		    result->type = VT_INVALID;
-		}
+		do_assignment_operator(info, ttype, result, &rhs);
 		break;
 	    }
 	default:
@@ -272,6 +367,26 @@ void parse_assignment(evalinfo_T *info, value_T *result)
     }
 }
 
+/* Applies the assignment operator `ttype' to the operands `lhs' and `rhs'.
+ * The result is assigned to the variable `lhs' refers to and to `*lhs'. */
+void do_assignment_operator(
+	evalinfo_T *info, atokentype_T ttype, value_T *lhs, value_T *rhs)
+{
+    if (lhs->type == VT_VAR) {
+	word_T saveword = lhs->v_var;
+	if (!do_binary_calculation(info, ttype, lhs, rhs, lhs))
+	    return;
+	if (!do_assignment(&saveword, lhs))
+	    info->error = true, lhs->type = VT_INVALID;
+    } else if (lhs->type != VT_INVALID) {
+	/* TRANSLATORS: This error message is shown when the target of an
+	 * assignment is not a variable. */
+	xerror(0, Ngt("arithmetic: cannot assign to a number"));
+	info->error = true;
+	lhs->type = VT_INVALID;
+    }
+}
+
 /* Assigns the specified `value' to the variable specified by `word'.
  * Returns false on error. */
 bool do_assignment(const word_T *word, const value_T *value)
@@ -463,6 +578,28 @@ long do_double_comparison(atokentype_T ttype, double v1, double v2)
     }
 }
 
+/* Compares the operands `lhs' and `rhs' with the equality or relational
+ * operator `ttype'. The result is assigned to `*lhs'. */
+void do_comparison(
+	evalinfo_T *info, atokentype_T ttype, value_T *lhs, value_T *rhs)
+{
+    switch (coerce_type(info, lhs, rhs)) {
+	case VT_LONG:
+	    lhs->v_long = do_long_calculation2(ttype, lhs->v_long, rhs->v_long);
+	    break;
+	case VT_DOUBLE:
+	    lhs->v_long =
+		do_double_comparison(ttype, lhs->v_double, rhs->v_double);
+	    lhs->type = VT_LONG;
+	    break;
+	case VT_INVALID:
+	    lhs->type = VT_INVALID;
+	    break;
+	case VT_VAR:
+	    assert(false);
+    }
+}
+
 /* Parses a conditional expression.
  *   ConditionalExp := LogicalOrExp
  *                   | LogicalOrExp "?" AssignmentExp ":" ConditionalExp */
@@ -658,22 +795,7 @@ void parse_equality(evalinfo_T *info, value_T *result)
 	    case TT_EXCLEQUAL:
 		next_token(info);
 		parse_relational(info, &rhs);
-		switch (coerce_type(info, result, &rhs)) {
-		    case VT_LONG:
-			result->v_long = do_long_calculation2(ttype,
-				result->v_long, rhs.v_long);
-			break;
-		    case VT_DOUBLE:
-			result->v_long = do_double_comparison(ttype,
-				result->v_double, rhs.v_double);
-			result->type = VT_LONG;
-			break;
-		    case VT_INVALID:
-			result->type = VT_INVALID;
-			break;
-		    case VT_VAR:
-			assert(false);
-		}
+		do_comparison(info, ttype, result, &rhs);
 		break;
 	    default:
 		return;
@@ -700,22 +822,7 @@ void parse_relational(evalinfo_T *info, value_T *result)
 	    case TT_GREATEREQUAL:
 		next_token(info);
 		parse_shift(info, &rhs);
-		switch (coerce_type(info, result, &rhs)) {
-		    case VT_LONG:
-			result->v_long = do_long_calculation2(ttype,
-				result->v_long, rhs.v_long);
-			break;
-		    case VT_DOUBLE:
-			result->v_long = do_double_comparison(ttype,
-				result->v_double, rhs.v_double);
-			result->type = VT_LONG;
-			break;
-		    case VT_INVALID:
-			result->type = VT_INVALID;
-			break;
-		    case VT_VAR:
-			assert(false);
-		}
+		do_comparison(info, ttype, result, &rhs);
 		break;
 	    default:
 		return;
@@ -811,53 +918,54 @@ void parse_prefix(evalinfo_T *info, value_T *result)
 			(ttype == TT_PLUSPLUS) ? L"++" : L"--");
 		info->error = true;
 		result->type = VT_INVALID;
-	    } else if (result->type == VT_VAR) {
-		word_T saveword = result->v_var;
-		coerce_number(info, result);
-		do_increment_or_decrement(ttype, result);
-		if (!do_assignment(&saveword, result))
-		    info->error = true, result->type = VT_INVALID;
-	    } else if (result->type != VT_INVALID) {
-		/* TRANSLATORS: This error message is shown when the operand of
-		 * the "++" or "--" operator is not a variable. */
-		xerror(0, Ngt("arithmetic: operator `%ls' requires a variable"),
-			(info->atoken.type == TT_PLUSPLUS) ? L"++" : L"--");
-		info->error = true;
-		result->type = VT_INVALID;
+	    } else {
+		do_prefix_increment(info, ttype, result);
 	    }
 	    break;
 	case TT_PLUS:
 	case TT_MINUS:
+	case TT_TILDE:
+	case TT_EXCL:
 	    next_token(info);
 	    parse_prefix(info, result);
-	    coerce_number(info, result);
+	    do_unary_calculation(info, ttype, result);
+	    break;
+	default:
+	    parse_postfix(info, result);
+	    break;
+    }
+}
+
+/* Applies the unary operator "+", "-", "~", or "!" to the specified value. */
+void do_unary_calculation(evalinfo_T *info, atokentype_T ttype, value_T *value)
+{
+    switch (ttype) {
+	case TT_PLUS:
+	case TT_MINUS:
+	    coerce_number(info, value);
 	    if (ttype == TT_MINUS) {
-		switch (result->type) {
-		case VT_LONG:     result->v_long = -result->v_long;      break;
-		case VT_DOUBLE:   result->v_double = -result->v_double;  break;
+		switch (value->type) {
+		case VT_LONG:     value->v_long = -value->v_long;      break;
+		case VT_DOUBLE:   value->v_double = -value->v_double;  break;
 		case VT_INVALID:  break;
 		default:          assert(false);
 		}
 	    }
 	    break;
 	case TT_TILDE:
-	    next_token(info);
-	    parse_prefix(info, result);
-	    coerce_integer(info, result);
-	    if (result->type == VT_LONG)
-		result->v_long = ~result->v_long;
+	    coerce_integer(info, value);
+	    if (value->type == VT_LONG)
+		value->v_long = ~value->v_long;
 	    break;
 	case TT_EXCL:
-	    next_token(info);
-	    parse_prefix(info, result);
-	    coerce_number(info, result);
-	    switch (result->type) {
+	    coerce_number(info, value);
+	    switch (value->type) {
 		case VT_LONG:
-		    result->v_long = !result->v_long;
+		    value->v_long = !value->v_long;
 		    break;
 		case VT_DOUBLE:
-		    result->type = VT_LONG;
-		    result->v_long = !result->v_double;
+		    value->type = VT_LONG;
+		    value->v_long = !value->v_double;
 		    break;
 		case VT_INVALID:
 		    break;
@@ -866,8 +974,27 @@ void parse_prefix(evalinfo_T *info, value_T *result)
 	    }
 	    break;
 	default:
-	    parse_postfix(info, result);
-	    break;
+	    assert(false);
+    }
+}
+
+/* Applies the prefix operator "++" or "--" to the specified value, which must
+ * be a variable. */
+void do_prefix_increment(evalinfo_T *info, atokentype_T ttype, value_T *value)
+{
+    if (value->type == VT_VAR) {
+	word_T saveword = value->v_var;
+	coerce_number(info, value);
+	do_increment_or_decrement(ttype, value);
+	if (!do_assignment(&saveword, value))
+	    info->error = true, value->type = VT_INVALID;
+    } else if (value->type != VT_INVALID) {
+	/* TRANSLATORS: This error message is shown when the operand of
+	 * the "++" or "--" operator is not a variable. */
+	xerror(0, Ngt("arithmetic: operator `%ls' requires a variable"),
+		(ttype == TT_PLUSPLUS) ? L"++" : L"--");
+	info->error = true;
+	value->type = VT_INVALID;
     }
 }
 
@@ -887,21 +1014,8 @@ void parse_postfix(evalinfo_T *info, value_T *result)
 			    (info->atoken.type == TT_PLUSPLUS) ? L"++" : L"--");
 		    info->error = true;
 		    result->type = VT_INVALID;
-		} else if (result->type == VT_VAR) {
-		    word_T saveword = result->v_var;
-		    coerce_number(info, result);
-		    value_T value = *result;
-		    do_increment_or_decrement(info->atoken.type, &value);
-		    if (!do_assignment(&saveword, &value)) {
-			info->error = true;
-			result->type = VT_INVALID;
-		    }
-		} else if (result->type != VT_INVALID) {
-		    xerror(0, Ngt("arithmetic: "
-				"operator `%ls' requires a variable"),
-			    (info->atoken.type == TT_PLUSPLUS) ? L"++" : L"--");
-		    info->error = true;
-		    result->type = VT_INVALID;
+		} else {
+		    do_postfix_increment(info, info->atoken.type, result);
 		}
 		next_token(info);
 		break;
@@ -911,6 +1025,28 @@ void parse_postfix(evalinfo_T *info, value_T *result)
     }
 }
 
+/* Applies the postfix operator "++" or "--" to the specified value, which
+ * must be a variable. The value is replaced with the original value of the
+ * variable. */
+void do_postfix_increment(evalinfo_T *info, atokentype_T ttype, value_T *value)
+{
+    if (value->type == VT_VAR) {
+	word_T saveword = value->v_var;
+	coerce_number(info, value);
+	value_T newvalue = *value;
+	do_increment_or_decrement(ttype, &newvalue);
+	if (!do_assignment(&saveword, &newvalue)) {
+	    info->error = true;
+	    value->type = VT_INVALID;
+	}
+    } else if (value->type != VT_INVALID) {
+	xerror(0, Ngt("arithmetic: operator `%ls' requires a variable"),
+		(ttype == TT_PLUSPLUS) ? L"++" : L"--");
+	info->error = true;
+	value->type = VT_INVALID;
+    }
+}
+
 /* Increment or decrement the specified value.
  * `ttype' must be either TT_PLUSPLUS or TT_MINUSMINUS and the `value' must be
  * `coerce_number'ed. */
@@ -976,29 +1112,39 @@ void parse_as_number(evalinfo_T *info, value_T *result)
     wcsncpy(wordstr, word->contents, word->length);
     wordstr[word->length] = L'\0';
 
+    if (!literal_to_number(info, wordstr, result)) {
+	xerror(0, Ngt("arithmetic: `%ls' is not a valid number"), wordstr);
+	info->error = true;
+	result->type = VT_INVALID;
+    }
+}
+
+/* Converts the specified number literal into a value.
+ * Returns false if the literal is not a valid number. */
+bool literal_to_number(
+	evalinfo_T *info, const wchar_t *literal, value_T *result)
+{
     long longresult;
-    if (xwcstol(wordstr, 0, &longresult)) {
+    if (xwcstol(literal, 0, &longresult)) {
 	result->type = VT_LONG;
 	result->v_long = longresult;
-	return;
+	return true;
     }
     if (!posixly_correct) {
 	double doubleresult;
 	wchar_t *end;
 	setlocale(LC_NUMERIC, "C");
 	errno = 0;
-	doubleresult = wcstod(wordstr, &end);
+	doubleresult = wcstod(literal, &end);
 	bool ok = (errno == 0 && *end == L'\0');
 	setlocale(LC_NUMERIC, info->savelocale);
 	if (ok) {
 	    result->type = VT_DOUBLE;
 	    result->v_double = doubleresult;
-	    return;
+	    return true;
 	}
     }
-    xerror(0, Ngt("arithmetic: `%ls' is not a valid number"), wordstr);
-    info->error = true;
-    result->type = VT_INVALID;
+    return false;
 }
 
 /* If the value is of the VT_VAR type, change it into VT_LONG/VT_DOUBLE.
@@ -1317,8 +1463,9 @@ parse_identifier:;
 		info->atoken.word.contents = &info->exp[startindex];
 		info->atoken.word.length = info->index - startindex;
 	    } else {
-		xerror(0, Ngt("arithmetic: `%lc' is not "
-			    "a valid number or operator"), (wint_t) c);
+		if (!info->quiet)
+		    xerror(0, Ngt("arithmetic: `%lc' is not "
+				"a valid number or operator"), (wint_t) c);
 		info->error = true;
 		info->atoken.type = TT_INVALID;
 	    }
@@ -1366,4 +1513,404 @@ fail:
     return true;
 }
 
+/* Cache of compiled expressions, keyed by the expression string. */
+static hashtable_T compiled_expressions;
+
+/* Returns the compiled program for the specified expression.
+ * The program is taken from the cache if available; otherwise, the expression
+ * is compiled and cached. NULL is returned if the expression cannot be
+ * compiled because it contains a syntax error or an invalid number literal, in
+ * which case the expression must be evaluated by the parser so that the error
+ * is reported. The returned program is valid until the next call to this
+ * function. */
+const arithprog_T *get_compiled_expression(const wchar_t *exp)
+{
+    if (compiled_expressions.capacity == 0)
+	ht_init(&compiled_expressions, hashwcs, htwcscmp);
+
+    arithprog_T *prog = ht_get(&compiled_expressions, exp).value;
+    if (prog != NULL) {
+	/* The program depends on the POSIXly-correct mode and, through the
+	 * `isw*' functions used in the tokenizer, on the LC_CTYPE locale. */
+	if (prog->posix == posixly_correct && prog->gen == locale_generation)
+	    return prog;
+	free_compiled_expression(ht_remove(&compiled_expressions, exp));
+    }
+
+    prog = compile(exp);
+    if (prog == NULL)
+	return NULL;
+    if (compiled_expressions.count >= ARITH_CACHE_MAX)
+	ht_clear(&compiled_expressions, free_compiled_expression);
+    ht_set(&compiled_expressions, prog->exp, prog);
+    return prog;
+}
+
+/* Frees the compiled program in the specified cache entry. The key is freed as
+ * part of the program. */
+void free_compiled_expression(kvpair_T kv)
+{
+    free_arithprog(kv.value);
+}
+
+/* Compiles the specified expression into a newly-malloced program.
+ * No error message is printed. Returns NULL on error. */
+arithprog_T *compile(const wchar_t *exp)
+{
+    arithprog_T *prog = xmalloc(sizeof *prog);
+    prog->exp = xwcsdup(exp);
+    prog->code = NULL;
+    prog->length = 0;
+    prog->maxdepth = 0;
+    prog->posix = posixly_correct;
+    prog->gen = locale_generation;
+
+    compinfo_T ci;
+    ci.eval.exp = prog->exp;
+    ci.eval.index = 0;
+    ci.eval.parseonly = false;
+    ci.eval.quiet = true;
+    ci.eval.error = false;
+    ci.eval.savelocale = xstrdup(setlocale(LC_NUMERIC, NULL));
+    ci.prog = prog;
+    ci.capacity = 0;
+    ci.depth = 0;
+
+    next_token(&ci.eval);
+    compile_assignment(&ci);
+    free(ci.eval.savelocale);
+
+    if (ci.eval.error || ci.eval.atoken.type != TT_NULL) {
+	free_arithprog(prog);
+	return NULL;
+    }
+    assert(ci.depth == 1);
+    return prog;
+}
+
+void free_arithprog(arithprog_T *prog)
+{
+    free(prog->exp);
+    free(prog->code);
+    free(prog);
+}
+
+/* Appends an instruction to the program being compiled.
+ * The stack depth is updated assuming the instruction is not jumping.
+ * Returns the index of the new instruction. */
+size_t emit(compinfo_T *ci, opcode_T opcode, atokentype_T ttype)
+{
+    arithprog_T *prog = ci->prog;
+    if (prog->length == ci->capacity) {
+	ci->capacity = ci->capacity * 2 + 8;
+	prog->code = xreallocn(prog->code, ci->capacity, sizeof *prog->code);
+    }
+
+    instr_T *instr = &prog->code[prog->length];
+    instr->opcode = opcode;
+    instr->ttype = ttype;
+    switch (opcode) {
+	case OP_PUSH:
+	    if (++ci->depth > prog->maxdepth)
+		prog->maxdepth = ci->depth;
+	    break;
+	case OP_BINARY:  case OP_COMPARE:  case OP_ASSIGN:
+	case OP_OR:  case OP_AND:  case OP_CONDITION:
+	    ci->depth--;
+	    break;
+	case OP_UNARY:  case OP_INCREMENT:  case OP_POSTINCREMENT:
+	case OP_BOOL:  case OP_JUMP:
+	    break;
+    }
+    return prog->length++;
+}
+
+/* The following functions compile the expression according to the same syntax
+ * as the `parse_*' functions above. */
+
+void compile_assignment(compinfo_T *ci)
+{
+    compile_conditional(ci);
+
+    atokentype_T ttype = ci->eval.atoken.type;
+    switch (ttype) {
+	case TT_EQUAL:          case TT_PLUSEQUAL:   case TT_MINUSEQUAL:
+	case TT_ASTEREQUAL:     case TT_SLASHEQUAL:  case TT_PERCENTEQUAL:
+	case TT_LESSLESSEQUAL:  case TT_GREATERGREATEREQUAL:
+	case TT_AMPEQUAL:       case TT_HATEQUAL:    case TT_PIPEEQUAL:
+	    next_token(&ci->eval);
+	    compile_assignment(ci);
+	    emit(ci, OP_ASSIGN, ttype);
+	    break;
+	default:
+	    break;
+    }
+}
+
+void compile_conditional(compinfo_T *ci)
+{
+    compile_logical_or(ci);
+    if (ci->eval.atoken.type != TT_QUESTION)
+	return;
+
+    next_token(&ci->eval);
+    size_t condition = emit(ci, OP_CONDITION, TT_QUESTION);
+    compile_assignment(ci);
+    if (ci->eval.atoken.type != TT_COLON) {
+	ci->eval.error = true;
+	return;
+    }
+
+    next_token(&ci->eval);
+    size_t jump = emit(ci, OP_JUMP, TT_COLON);
+    ci->prog->code[condition].target = ci->prog->length;
+    ci->depth--;
+    compile_conditional(ci);
+    ci->prog->code[condition].endtarget = ci->prog->length;
+    ci->prog->code[jump].target = ci->prog->length;
+}
+
+void compile_logical_or(compinfo_T *ci)
+{
+    compile_logical_and(ci);
+    while (ci->eval.atoken.type == TT_PIPEPIPE) {
+	next_token(&ci->eval);
+	size_t test = emit(ci, OP_OR, TT_PIPEPIPE);
+	compile_logical_and(ci);
+	emit(ci, OP_BOOL, TT_PIPEPIPE);
+	ci->prog->code[test].target = ci->prog->length;
+    }
+}
+
+void compile_logical_and(compinfo_T *ci)
+{
+    compile_binary(ci, 0);
+    while (ci->eval.atoken.type == TT_AMPAMP) {
+	next_token(&ci->eval);
+	size_t test = emit(ci, OP_AND, TT_AMPAMP);
+	compile_binary(ci, 0);
+	emit(ci, OP_BOOL, TT_AMPAMP);
+	ci->prog->code[test].target = ci->prog->length;
+    }
+}
+
+/* Returns the precedence of the specified left-associative binary operator,
+ * which corresponds to one of `parse_inclusive_or' to `parse_multiplicative'.
+ * Returns -1 if the token is not such an operator. */
+int binary_precedence(atokentype_T ttype)
+{
+    switch (ttype) {
+	case TT_PIPE:
+	    return 0;
+	case TT_HAT:
+	    return 1;
+	case TT_AMP:
+	    return 2;
+	case TT_EQUALEQUAL:  case TT_EXCLEQUAL:
+	    return 3;
+	case TT_LESS:     case TT_LESSEQUAL:
+	case TT_GREATER:  case TT_GREATEREQUAL:
+	    return 4;
+	case TT_LESSLESS:  case TT_GREATERGREATER:
+	    return 5;
+	case TT_PLUS:  case TT_MINUS:
+	    return 6;
+	case TT_ASTER:  case TT_SLASH:  case TT_PERCENT:
+	    return 7;
+	default:
+	    return -1;
+    }
+}
+
+void compile_binary(compinfo_T *ci, int precedence)
+{
+    if (precedence > 7) {
+	compile_prefix(ci);
+	return;
+    }
+
+    compile_binary(ci, precedence + 1);
+    while (binary_precedence(ci->eval.atoken.type) == precedence) {
+	atokentype_T ttype = ci->eval.atoken.type;
+	next_token(&ci->eval);
+	compile_binary(ci, precedence + 1);
+	emit(ci, (precedence == 3 || precedence == 4) ? OP_COMPARE : OP_BINARY,
+		ttype);
+    }
+}
+
+void compile_prefix(compinfo_T *ci)
+{
+    atokentype_T ttype = ci->eval.atoken.type;
+    switch (ttype) {
+	case TT_PLUSPLUS:
+	case TT_MINUSMINUS:
+	    if (posixly_correct) {
+		ci->eval.error = true;
+		return;
+	    }
+	    next_token(&ci->eval);
+	    compile_prefix(ci);
+	    emit(ci, OP_INCREMENT, ttype);
+	    break;
+	case TT_PLUS:
+	case TT_MINUS:
+	case TT_TILDE:
+	case TT_EXCL:
+	    next_token(&ci->eval);
+	    compile_prefix(ci);
+	    emit(ci, OP_UNARY, ttype);
+	    break;
+	default:
+	    compile_postfix(ci);
+	    break;
+    }
+}
+
+void compile_postfix(compinfo_T *ci)
+{
+    compile_primary(ci);
+    for (;;) {
+	switch (ci->eval.atoken.type) {
+	    case TT_PLUSPLUS:
+	    case TT_MINUSMINUS:
+		if (posixly_correct) {
+		    ci->eval.error = true;
+		    return;
+		}
+		emit(ci, OP_POSTINCREMENT, ci->eval.atoken.type);
+		next_token(&ci->eval);
+		break;
+	    default:
+		return;
+	}
+    }
+}
+
+void compile_primary(compinfo_T *ci)
+{
+    value_T value;
+    switch (ci->eval.atoken.type) {
+	case TT_LPAREN:
+	    next_token(&ci->eval);
+	    compile_assignment(ci);
+	    if (ci->eval.atoken.type != TT_RPAREN) {
+		ci->eval.error = true;
+		return;
+	    }
+	    next_token(&ci->eval);
+	    return;
+	case TT_NUMBER:
+	    {
+		word_T *word = &ci->eval.atoken.word;
+		wchar_t wordstr[word->length + 1];
+		wmemcpy(wordstr, word->contents, word->length);
+		wordstr[word->length] = L'\0';
+		if (!literal_to_number(&ci->eval, wordstr, &value)) {
+		    ci->eval.error = true;
+		    return;
+		}
+	    }
+	    break;
+	case TT_IDENTIFIER:
+	    value.type = VT_VAR;
+	    value.v_var = ci->eval.atoken.word;
+	    break;
+	default:
+	    ci->eval.error = true;
+	    return;
+    }
+    size_t push = emit(ci, OP_PUSH, TT_NULL);
+    ci->prog->code[push].value = value;
+    next_token(&ci->eval);
+}
+
+/* Executes the compiled program and assigns the result to `*result'.
+ * On error, an error message is printed and `info->error' is set to true. The
+ * error messages and side effects are the same as those of the parser. */
+void execute(const arithprog_T *prog, value_T *result, evalinfo_T *info)
+{
+    value_T stack[prog->maxdepth];
+    size_t sp = 0;  /* stack pointer: number of values in the stack */
+    size_t pc = 0;  /* program counter: index of the next instruction */
+
+    while (pc < prog->length) {
+	const instr_T *instr = &prog->code[pc++];
+	value_T *top = &stack[sp > 0 ? sp - 1 : 0];
+	bool value = false;
+
+	switch (instr->opcode) {
+	    case OP_PUSH:
+		stack[sp++] = instr->value;
+		break;
+	    case OP_BINARY:
+		sp--;
+		do_binary_calculation(
+			info, instr->ttype, top - 1, top, top - 1);
+		break;
+	    case OP_COMPARE:
+		sp--;
+		do_comparison(info, instr->ttype, top - 1, top);
+		break;
+	    case OP_ASSIGN:
+		sp--;
+		do_assignment_operator(info, instr->ttype, top - 1, top);
+		break;
+	    case OP_UNARY:
+		do_unary_calculation(info, instr->ttype, top);
+		break;
+	    case OP_INCREMENT:
+		do_prefix_increment(info, instr->ttype, top);
+		break;
+	    case OP_POSTINCREMENT:
+		do_postfix_increment(info, instr->ttype, top);
+		break;
+	    case OP_OR:
+	    case OP_AND:
+		coerce_number(info, top);
+		switch (top->type) {
+		    case VT_INVALID: pc = instr->target;  continue;
+		    case VT_LONG:    value = top->v_long;    break;
+		    case VT_DOUBLE:  value = top->v_double;  break;
+		    default:         assert(false);
+		}
+		if (value == (instr->opcode == OP_OR)) {
+		    top->type = VT_LONG, top->v_long = value;
+		    pc = instr->target;
+		} else {
+		    sp--;
+		}
+		break;
+	    case OP_BOOL:
+		coerce_number(info, top);
+		switch (top->type) {
+		    case VT_INVALID: continue;
+		    case VT_LONG:    value = top->v_long;    break;
+		    case VT_DOUBLE:  value = top->v_double;  break;
+		    default:         assert(false);
+		}
+		top->type = VT_LONG, top->v_long = value;
+		break;
+	    case OP_CONDITION:
+		coerce_number(info, top);
+		switch (top->type) {
+		    case VT_INVALID: pc = instr->endtarget;  continue;
+		    case VT_LONG:    value = top->v_long;    break;
+		    case VT_DOUBLE:  value = top->v_double;  break;
+		    default:         assert(false);
+		}
+		sp--;
+		if (!value)
+		    pc = instr->target;
+		break;
+	    case OP_JUMP:
+		pc = instr->target;
+		break;
+	}
+    }
+
+    assert(sp == 1);
+    *result = stack[0];
+}
+
 /* vim: set ts=8 sts=4 sw=4 noet tw=80: */
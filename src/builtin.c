@@ -141,6 +141,10 @@ void init_builtin(void)
 	    getopts_syntax, help_option);
     DEFBUILTIN("read", read_builtin, BI_SEMISPECIAL, read_help, read_syntax,
 	    read_options);
+#if YASH_ENABLE_ARRAY
+    DEFBUILTIN("readarray", readarray_builtin, BI_REGULAR, readarray_help,
+	    readarray_syntax, readarray_options);
+#endif
 #if YASH_ENABLE_DIRSTACK
     DEFBUILTIN("pushd", pushd_builtin, BI_SEMISPECIAL, pushd_help, pushd_syntax,
 	    pushd_options);
@@ -34,6 +34,7 @@
 #include "../builtin.h"
 #include "../exec.h"
 #include "../option.h"
+#include "../redir.h"
 #include "../strbuf.h"
 #include "../util.h"
 #include "../variable.h"
@@ -61,13 +62,17 @@ struct format_T {
 	    unsigned long width, max;
 	} echo;
     } value;
+    bool plain;
 };
 /* The FT_NONE format type corresponds to the "%%" conversion specification.
  * The FT_RAW format type is used for literal strings that are not conversion
  * specifications. The format types of FT_STRING, FT_CHAR, FT_INT, FT_UINT, and
  * FT_FLOAT are used for various types of conversion specifications (`convspec')
  * that require a value of the corresponding type.
- * The FT_ECHO format type is used for the "b" conversion specification. */
+ * The FT_ECHO format type is used for the "b" conversion specification.
+ * `plain' is true if the conversion specification is one of "%s", "%d", "%i",
+ * and "%x" without any flags, field width, or precision. Such a specification
+ * is formatted without the `sb_printf' function. */
 /* FT_STRING  -> wchar_t *
  * FT_CHAR    -> wint_t
  * FT_INT     -> intmax_t
@@ -78,6 +83,11 @@ enum printf_result_T { PR_OK, PR_OK_END, PR_ERROR, };
 static enum printf_result_T echo_parse_escape(const wchar_t *restrict s,
 	xstrbuf_T *restrict buf, mbstate_t *restrict st)
     __attribute__((nonnull));
+static bool find_cached_format(
+	const wchar_t *source, struct format_T **resultp)
+    __attribute__((nonnull));
+static bool cache_format(const wchar_t *source, struct format_T *format)
+    __attribute__((nonnull(1)));
 static bool printf_parse_format(
 	const wchar_t *format, struct format_T **resultp)
     __attribute__((nonnull));
@@ -90,6 +100,9 @@ static enum printf_result_T printf_printf(
 	const struct format_T *format, const wchar_t *arg, xstrbuf_T *buf)
     __attribute__((nonnull(1,3)));
 static uintmax_t printf_parse_integer(const wchar_t *arg, bool is_signed);
+static void printf_print_integer(
+	xstrbuf_T *buf, uintmax_t value, bool negative, unsigned base)
+    __attribute__((nonnull));
 static enum printf_result_T printf_print_escape(
 	const struct format_T *format, const wchar_t *arg, xstrbuf_T *buf)
     __attribute__((nonnull));
@@ -191,12 +204,7 @@ int echo_builtin(int argc, void **argv)
 
     /* print to the standard output */
 print:
-    clearerr(stdout);
-    fwrite(buf.contents, sizeof *buf.contents, buf.length, stdout);
-    if (ferror(stdout))
-	goto error;
-
-    if (fflush(stdout) != 0)
+    if (!write_stdout_buffered(buf.contents, buf.length))
 	goto error;
 
     sb_destroy(&buf);
@@ -292,10 +300,15 @@ int printf_builtin(int argc, void **argv)
 	return insufficient_operands_error(1);
 
     /* parse the format string */
-    struct format_T *format = NULL;
-    if (!printf_parse_format(ARGV(xoptind), &format)) {
-	freeformat(format);
-	return Exit_FAILURE;
+    struct format_T *format;
+    bool cached = find_cached_format(ARGV(xoptind), &format);
+    if (!cached) {
+	format = NULL;
+	if (!printf_parse_format(ARGV(xoptind), &format)) {
+	    freeformat(format);
+	    return Exit_FAILURE;
+	}
+	cached = cache_format(ARGV(xoptind), format);
     }
     xoptind++;
 
@@ -315,26 +328,81 @@ int printf_builtin(int argc, void **argv)
     } while (xoptind < argc && xoptind != oldoptind);
 
 print:
-    freeformat(format);
-
     /* print the result to the standard output */
-    clearerr(stdout);
-    fwrite(buf.contents, sizeof *buf.contents, buf.length, stdout);
-    if (ferror(stdout))
-	goto error;
-
-    if (fflush(stdout) != 0)
+    if (!write_stdout_buffered(buf.contents, buf.length))
 	goto error;
 
+    if (!cached)
+	freeformat(format);
     sb_destroy(&buf);
     return (yash_error_message_count == 0) ? Exit_SUCCESS : Exit_FAILURE;
 
 error:
+    if (!cached)
+	freeformat(format);
     xerror(errno, Ngt("cannot print to the standard output"));
     sb_destroy(&buf);
     return Exit_FAILURE;
 }
 
+/* The number of parsed formats remembered in `formatcache'. */
+#ifndef FORMAT_CACHE_SIZE
+#define FORMAT_CACHE_SIZE 8
+#endif
+
+/* Parsed formats of the "printf" built-in that have recently been used.
+ * The most recently used one comes first. An unused entry has a NULL `source'.
+ * Scripts that call "printf" in a loop tend to use the same format again and
+ * again, so the formats are reused instead of being parsed every time. */
+static struct {
+    wchar_t *source;
+    struct format_T *format;
+} formatcache[FORMAT_CACHE_SIZE];
+
+/* Looks up the format cache for format string `source'.
+ * If found, the parsed format is assigned to `*resultp', the cache entry is
+ * moved to the front, and true is returned. Otherwise, false is returned. */
+bool find_cached_format(const wchar_t *source, struct format_T **resultp)
+{
+    for (size_t i = 0; i < FORMAT_CACHE_SIZE; i++) {
+	if (formatcache[i].source == NULL)
+	    break;
+	if (wcscmp(formatcache[i].source, source) == 0) {
+	    wchar_t *s = formatcache[i].source;
+	    struct format_T *f = formatcache[i].format;
+	    memmove(&formatcache[1], &formatcache[0], i * sizeof *formatcache);
+	    formatcache[0].source = s;
+	    formatcache[0].format = f;
+	    *resultp = f;
+	    return true;
+	}
+    }
+    return false;
+}
+
+/* Adds the parsed format for format string `source' to the format cache,
+ * dropping the least recently used entry if the cache is full.
+ * Returns true if the format has been added, in which case the format must not
+ * be freed by the caller.
+ * Formats that contain non-ASCII characters are not cached because the result
+ * of parsing them depends on the current locale. */
+bool cache_format(const wchar_t *source, struct format_T *format)
+{
+    for (const wchar_t *s = source; *s != L'\0'; s++)
+	if ((unsigned long) *s >= 0x80)
+	    return false;
+
+    size_t last = FORMAT_CACHE_SIZE - 1;
+    if (formatcache[last].source != NULL) {
+	free(formatcache[last].source);
+	freeformat(formatcache[last].format);
+    }
+    memmove(&formatcache[1], &formatcache[0], last * sizeof *formatcache);
+    formatcache[0].source = xwcsdup(source);
+    formatcache[0].format = format;
+    return true;
+}
+
 /* Parses the format for the "printf" built-in.
  * If successful, a pointer to the result is assigned to `*resultp' and true is
  * returned.
@@ -351,6 +419,7 @@ bool printf_parse_format(const wchar_t *format, struct format_T **resultp)
 	    f->type = FT_RAW;                        \
 	    f->value.raw.length = buf.length;        \
 	    f->value.raw.value = sb_tostr(&buf);     \
+	    f->plain = false;                        \
 	    *resultp = f;                            \
 	    resultp = &f->next;                      \
 	} else                                       \
@@ -537,6 +606,8 @@ flag_error:
     result = xmalloc(sizeof *result);
     result->next = NULL;
     result->type = type;
+    result->plain = buf.length == 3 && (format[-1] == L's' ||
+	    format[-1] == L'd' || format[-1] == L'i' || format[-1] == L'x');
     switch (type) {
 	case FT_NONE:
 	    sb_destroy(&buf);
@@ -567,6 +638,7 @@ struct format_T *printf_parse_percent_b(xstrbuf_T *convspec)
 
     result->next = NULL;
     result->type = FT_ECHO;
+    result->plain = false;
     result->value.echo.left = false;
 
     assert(convspec->contents[index] == '%');
@@ -620,8 +692,17 @@ enum printf_result_T printf_printf(
 		xoptind++;
 	    else
 		arg = L"";
-	    if (sb_printf(buf, format->value.convspec, arg) < 0)
-		return PR_ERROR;
+	    if (format->plain) {
+		mbstate_t state;
+		memset(&state, 0, sizeof state);
+		if (sb_wcscat(buf, arg, &state) != NULL) {
+		    errno = EILSEQ;
+		    return PR_ERROR;
+		}
+	    } else {
+		if (sb_printf(buf, format->value.convspec, arg) < 0)
+		    return PR_ERROR;
+	    }
 	    return PR_OK;
 	case FT_CHAR:
 	    if (arg != NULL && arg[0] != L'\0') {
@@ -631,14 +712,27 @@ enum printf_result_T printf_printf(
 	    }
 	    return PR_OK;
 	case FT_INT:
-	    if (sb_printf(buf, format->value.convspec,
-			printf_parse_integer(arg, true)) < 0)
-		return PR_ERROR;
+	    if (format->plain) {
+		intmax_t value = (intmax_t) printf_parse_integer(arg, true);
+		if (value < 0)
+		    printf_print_integer(buf, -(uintmax_t) value, true, 10);
+		else
+		    printf_print_integer(buf, (uintmax_t) value, false, 10);
+	    } else {
+		if (sb_printf(buf, format->value.convspec,
+			    printf_parse_integer(arg, true)) < 0)
+		    return PR_ERROR;
+	    }
 	    return PR_OK;
 	case FT_UINT:
-	    if (sb_printf(buf, format->value.convspec,
-			printf_parse_integer(arg, false)) < 0)
-		return PR_ERROR;
+	    if (format->plain) {
+		printf_print_integer(
+			buf, printf_parse_integer(arg, false), false, 16);
+	    } else {
+		if (sb_printf(buf, format->value.convspec,
+			    printf_parse_integer(arg, false)) < 0)
+		    return PR_ERROR;
+	    }
 	    return PR_OK;
 	case FT_FLOAT:
 	    {
@@ -696,6 +790,25 @@ uintmax_t printf_parse_integer(const wchar_t *arg, bool is_signed)
     return value;
 }
 
+/* Appends the digits of the specified integer in the specified base to buffer
+ * `buf'. If `negative' is true, a minus sign is prepended. Lowercase letters
+ * are used for digits above 9. */
+void printf_print_integer(
+	xstrbuf_T *buf, uintmax_t value, bool negative, unsigned base)
+{
+    char digits[sizeof value * CHAR_BIT + 1];
+    char *p = &digits[sizeof digits];
+
+    assert(2 <= base && base <= 16);
+    do {
+	*--p = "0123456789abcdef"[value % base];
+	value /= base;
+    } while (value > 0);
+    if (negative)
+	*--p = '-';
+    sb_ncat_force(buf, p, &digits[sizeof digits] - p);
+}
+
 /* Prints the specified string that may include escape sequences and formats it
  * in the specified format. */
 enum printf_result_T printf_print_escape(
@@ -30,11 +30,15 @@
 # include <paths.h>
 #endif
 #include <signal.h>
+#if HAVE_POSIX_SPAWN
+# include <spawn.h>
+#endif
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <sys/times.h>
 #include <unistd.h>
 #include <wchar.h>
@@ -81,6 +85,9 @@ typedef struct pipeinfo_T {
 } pipeinfo_T;
 #define PIPEINFO_INIT { -1, { -1, -1 }, }
 
+/* size of the blocks in which the output of command substitution is read */
+#define CMDSUB_BLOCK_SIZE 65536
+
 /* values used to specify the behavior of command search. */
 typedef enum srchcmdtype_T {
     SCT_EXTERNAL = 1 << 0,  /* search for an external command */
@@ -141,6 +148,10 @@ static void exec_while(const command_T *c, bool finally_exit)
     __attribute__((nonnull));
 static void exec_case(const command_T *c, bool finally_exit)
     __attribute__((nonnull));
+static xfnmatch_T *const *get_case_matchers(caseitem_T *ci)
+    __attribute__((nonnull));
+static bool is_constant_pattern(const wordunit_T *w)
+    __attribute__((pure));
 static void exec_funcdef(const command_T *c, bool finally_exit)
     __attribute__((nonnull));
 
@@ -173,6 +184,11 @@ static void exec_nonsimple_command(command_T *c, bool finally_exit)
 static void exec_simple_command(const commandinfo_T *ci,
 	int argc, char *argv0, void **argv, bool finally_exit)
     __attribute__((nonnull));
+#if HAVE_POSIX_SPAWN
+static pid_t spawn_external_program(
+	const char *path, int argc, char *argv0, void **argv, char **envs)
+    __attribute__((nonnull(1,4)));
+#endif
 static void exec_external_program(
 	const char *path, int argc, char *argv0, void **argv, char **envs)
     __attribute__((nonnull));
@@ -187,6 +203,31 @@ static inline int xexecve(
 	const char *path, char *const *argv, char *const *envp)
     __attribute__((nonnull(1)));
 
+static const redir_T *get_file_cmdsub_redirection(const and_or_T *a)
+    __attribute__((nonnull,pure));
+static wchar_t *read_file_cmdsub_in_process(
+	const redir_T *r, char **filenamep)
+    __attribute__((nonnull,warn_unused_result));
+static void copy_file_cmdsub(const redir_T *r, char *filename)
+    __attribute__((nonnull(1),noreturn));
+static bool is_cmdsub_in_process_safe(const and_or_T *a)
+    __attribute__((nonnull));
+static bool are_safe_and_or_lists(const and_or_T *a, unsigned depth);
+static bool is_safe_command(const command_T *c, unsigned depth)
+    __attribute__((nonnull));
+static bool is_safe_simple_command(const command_T *c, unsigned depth)
+    __attribute__((nonnull));
+static bool are_safe_redirections(const redir_T *r);
+static bool are_safe_words(void *const *words)
+    __attribute__((nonnull));
+static bool is_literal_word(const wordunit_T *w, const wchar_t *s)
+    __attribute__((nonnull(2)));
+static wchar_t *exec_command_substitution_in_process(const and_or_T *a)
+    __attribute__((nonnull,malloc,warn_unused_result));
+static void read_cmdsub_output(int fd, xwcsbuf_T *buf)
+    __attribute__((nonnull));
+static wchar_t *finish_cmdsub_output(xwcsbuf_T *buf)
+    __attribute__((nonnull,malloc,warn_unused_result));
 static int exec_iteration(void *const *commands, const char *codename)
     __attribute__((nonnull));
 
@@ -518,14 +559,21 @@ void exec_case(const command_T *c, bool finally_exit)
     if (word == NULL)
 	goto fail;
 
-    for (const caseitem_T *ci = c->c_casitems; ci != NULL; ci = ci->next) {
-	for (void **pats = ci->ci_patterns; *pats != NULL; pats++) {
-	    wchar_t *pattern = expand_single(*pats, TT_SINGLE, true, false);
-	    if (pattern == NULL)
-		goto fail;
+    for (caseitem_T *ci = c->c_casitems; ci != NULL; ci = ci->next) {
+	xfnmatch_T *const *matchers = get_case_matchers(ci);
+	for (size_t i = 0; ci->ci_patterns[i] != NULL; i++) {
+	    bool match;
+	    if (matchers[i] != NULL) {
+		match = (xfnm_wmatch(matchers[i], word).start != (size_t) -1);
+	    } else {
+		wchar_t *pattern =
+		    expand_single(ci->ci_patterns[i], TT_SINGLE, true, false);
+		if (pattern == NULL)
+		    goto fail;
 
-	    bool match = match_pattern(word, pattern);
-	    free(pattern);
+		match = match_pattern(word, pattern);
+		free(pattern);
+	    }
 	    if (match) {
 		if (ci->ci_commands != NULL) {
 		    exec_and_or_lists(ci->ci_commands, finally_exit);
@@ -550,6 +598,49 @@ fail:
     goto done;
 }
 
+/* Returns the array of compiled patterns cached in the specified case item.
+ * If the cache does not exist or is outdated, it is (re)created. Patterns that
+ * contain no expansions are compiled here once and for all; the elements for
+ * the other patterns are NULL and the patterns must be expanded and compiled
+ * each time they are matched. */
+xfnmatch_T *const *get_case_matchers(caseitem_T *ci)
+{
+    if (ci->ci_matchers != NULL && ci->ci_matchergen == locale_generation)
+	return ci->ci_matchers;
+
+    free_case_matchers(ci);
+
+    size_t count = plcount(ci->ci_patterns);
+    xfnmatch_T **matchers = xmallocn(count, sizeof *matchers);
+    for (size_t i = 0; i < count; i++) {
+	matchers[i] = NULL;
+	if (!is_constant_pattern(ci->ci_patterns[i]))
+	    continue;
+
+	wchar_t *pattern =
+	    expand_single(ci->ci_patterns[i], TT_SINGLE, true, false);
+	if (pattern != NULL) {
+	    matchers[i] = xfnm_compile(pattern, XFNM_HEADONLY | XFNM_TAILONLY);
+	    free(pattern);
+	}
+    }
+    ci->ci_matchers = matchers;
+    ci->ci_matchergen = locale_generation;
+    return matchers;
+}
+
+/* Checks if the specified case pattern always expands to the same string.
+ * The pattern must not contain any expansions, including tilde expansion. */
+bool is_constant_pattern(const wordunit_T *w)
+{
+    if (w != NULL && w->wu_type == WT_STRING && w->wu_string[0] == L'~')
+	return false;
+    for (; w != NULL; w = w->next)
+	if (w->wu_type != WT_STRING)
+	    return false;
+    return true;
+}
+
 /* Executes the function definition. */
 void exec_funcdef(const command_T *c, bool finally_exit)
 {
@@ -914,6 +1005,22 @@ pid_t exec_process(
     /* create a child process to execute the external command */
     if (cmdinfo.type == CT_EXTERNALPROGRAM && !finally_exit) {
 	assert(type == E_NORMAL);
+	/* Build the environment before forking so that it is cached for the
+	 * following commands. */
+	char **envs = get_environ();
+#if HAVE_POSIX_SPAWN
+	/* Without job control, the child needs no setup other than the
+	 * signal settings, so we can avoid the cost of forking the shell. */
+	if (!doing_job_control_now) {
+	    cpid = spawn_external_program(
+		    cmdinfo.ci_path, argc, argv0, argv, envs);
+	    if (cpid > 0)
+		goto done3;
+	    cpid = 0;
+	}
+#else
+	(void) envs;
+#endif
 	cpid = fork_and_reset(pgid, true, t_leave);
 	if (cpid != 0)
 	    goto done3;
@@ -1003,6 +1110,11 @@ pid_t fork_and_reset(pid_t pgid, bool fg, sigtype_T sigtype)
 	sigprocmask(SIG_BLOCK, &all, &savemask);
     }
 
+    /* The child must not inherit the buffered output. The input read ahead
+     * from the standard input is handed back if possible so that the child can
+     * read it. Otherwise, it remains only in the parent's buffer. */
+    flush_stdout();
+    unread_input(stdin_input_file_info, false);
     pid_t cpid = fork();
 
     if (cpid != 0) {
@@ -1018,6 +1130,8 @@ pid_t fork_and_reset(pid_t pgid, bool fg, sigtype_T sigtype)
 	    sigprocmask(SIG_SETMASK, &savemask, NULL);
     } else {
 	/* child process */
+	unread_input(stdin_input_file_info, true);
+
 	bool save_doing_job_control_now = doing_job_control_now;
 	if (save_doing_job_control_now && pgid >= 0) {
 	    setpgid(0, pgid);
@@ -1253,7 +1367,7 @@ void exec_simple_command(
 	    }
 	    finally_exit = true;
 	}
-	exec_external_program(ci->ci_path, argc, argv0, argv, environ);
+	exec_external_program(ci->ci_path, argc, argv0, argv, get_environ());
 	break;
     case CT_SPECIALBUILTIN:
     case CT_SEMISPECIALBUILTIN:
@@ -1275,6 +1389,62 @@ void exec_simple_command(
 	exit_shell();
 }
 
+#if HAVE_POSIX_SPAWN
+
+/* Starts the external program in a new child process by `posix_spawn'.
+ * The arguments are the same as those of `exec_external_program'.
+ * The child is given the same signal settings as a child created by
+ * `fork_and_reset' with `t_leave'. File descriptors need no setup because
+ * redirections have been performed in the shell and shell FDs are close-on-
+ * exec.
+ * Returns the process ID of the child if successful. If the signal settings
+ * cannot be applied by `posix_spawn' or the program could not be executed,
+ * -1 is returned without printing any error message. Then the caller should
+ * fork and exec the program instead, which reports any error or falls back on
+ * the shell for a script without a shebang. */
+pid_t spawn_external_program(
+	const char *path, int argc, char *argv0, void **argv, char **envs)
+{
+    sigset_t defaults, mask;
+    sigemptyset(&defaults);
+    if (!get_spawn_signal_settings(&defaults, &mask))
+	return -1;
+
+    posix_spawnattr_t attr;
+    if (posix_spawnattr_init(&attr) != 0)
+	return -1;
+
+    char *mbsargv[argc + 1];
+    mbsargv[0] = argv0;
+    for (int i = 1; i < argc; i++) {
+	mbsargv[i] = malloc_wcstombs(argv[i]);
+	if (mbsargv[i] == NULL)
+	    mbsargv[i] = xstrdup("");
+    }
+    mbsargv[argc] = NULL;
+
+    pid_t cpid;
+    int err = posix_spawnattr_setsigdefault(&attr, &defaults);
+    if (err == 0)
+	err = posix_spawnattr_setsigmask(&attr, &mask);
+    if (err == 0)
+	err = posix_spawnattr_setflags(&attr,
+		POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK);
+    if (err == 0) {
+	flush_stdout();
+	unread_input(stdin_input_file_info, false);
+	err = posix_spawn(&cpid, path, NULL, &attr, mbsargv, envs);
+    }
+    posix_spawnattr_destroy(&attr);
+
+    for (int i = 1; i < argc; i++)
+	free(mbsargv[i]);
+
+    return (err == 0) ? cpid : -1;
+}
+
+#endif /* HAVE_POSIX_SPAWN */
+
 /* Executes the external program.
  *  path:  path to the program to be executed
  *  argc:  number of strings in `argv'
@@ -1443,6 +1613,8 @@ void exec_function_body(
 /* Calls `execve' until it doesn't return EINTR. */
 int xexecve(const char *path, char *const *argv, char *const *envp)
 {
+    flush_stdout();
+    unread_input(stdin_input_file_info, false);
     do
 	execve(path, argv, envp);
     while (errno == EINTR);
@@ -1463,9 +1635,27 @@ wchar_t *exec_command_substitution(const embedcmd_T *cmdsub)
 	    : cmdsub->value.unparsed[0] == L'\0')  /* empty command */
 	return xwcsdup(L"");
 
+    const redir_T *filecmdsub = cmdsub->is_preparsed
+	? get_file_cmdsub_redirection(cmdsub->value.preparsed) : NULL;
+    char *filename = NULL;
+    if (filecmdsub != NULL) {
+	wchar_t *result = read_file_cmdsub_in_process(filecmdsub, &filename);
+	if (result != NULL)
+	    return result;
+	/* fall back on forking */
+    } else if (cmdsub->is_preparsed
+	    && is_cmdsub_in_process_safe(cmdsub->value.preparsed)) {
+	wchar_t *result =
+	    exec_command_substitution_in_process(cmdsub->value.preparsed);
+	if (result != NULL)
+	    return result;
+	/* fall back on forking */
+    }
+
     /* open a pipe to receive output from the command */
     if (pipe(pipefd) < 0) {
 	xerror(errno, Ngt("cannot open a pipe for the command substitution"));
+	free(filename);
 	return NULL;
     }
 
@@ -1477,29 +1667,19 @@ wchar_t *exec_command_substitution(const embedcmd_T *cmdsub)
 	/* fork failure */
 	xclose(pipefd[PIPE_IN]);
 	xclose(pipefd[PIPE_OUT]);
+	free(filename);
 	lastcmdsubstatus = Exit_NOEXEC;
 	return NULL;
     } else if (cpid > 0) {
 	/* parent process */
-	FILE *f;
-
 	xclose(pipefd[PIPE_OUT]);
-	f = fdopen(pipefd[PIPE_IN], "r");
-	if (f == NULL) {
-	    xerror(errno,
-		    Ngt("cannot open a pipe for the command substitution"));
-	    xclose(pipefd[PIPE_IN]);
-	    lastcmdsubstatus = Exit_NOEXEC;
-	    return NULL;
-	}
+	free(filename);
 
 	/* read output from the command */
 	xwcsbuf_T buf;
-	wint_t c;
 	wb_init(&buf);
-	while ((c = fgetwc(f)) != WEOF)
-	    wb_wccat(&buf, c);
-	fclose(f);
+	read_cmdsub_output(pipefd[PIPE_IN], &buf);
+	xclose(pipefd[PIPE_IN]);
 
 	/* wait for the child to finish */
 	int savelaststatus = laststatus;
@@ -1507,11 +1687,7 @@ wchar_t *exec_command_substitution(const embedcmd_T *cmdsub)
 	lastcmdsubstatus = laststatus;
 	laststatus = savelaststatus;
 
-	/* trim trailing newlines and return */
-	size_t len = buf.length;
-	while (len > 0 && buf.contents[len - 1] == L'\n')
-	    len--;
-	return wb_towcs(wb_truncate(&buf, len));
+	return finish_cmdsub_output(&buf);
     } else {
 	/* child process */
 	xclose(pipefd[PIPE_IN]);
@@ -1521,7 +1697,9 @@ wchar_t *exec_command_substitution(const embedcmd_T *cmdsub)
 	    xclose(pipefd[PIPE_OUT]);
 	}
 
-	if (cmdsub->is_preparsed)
+	if (filecmdsub != NULL)
+	    copy_file_cmdsub(filecmdsub, filename);
+	else if (cmdsub->is_preparsed)
 	    exec_and_or_lists(cmdsub->value.preparsed, true);
 	else
 	    exec_wcs(cmdsub->value.unparsed, gt("command substitution"), true);
@@ -1529,6 +1707,450 @@ wchar_t *exec_command_substitution(const embedcmd_T *cmdsub)
     }
 }
 
+/* Returns the redirection if the commands of a command substitution consist of
+ * a single input redirection of the standard input, as in "$(<file)". Such a
+ * command substitution is substituted with the contents of the file.
+ * NULL is returned otherwise or in the POSIXly-correct mode. */
+const redir_T *get_file_cmdsub_redirection(const and_or_T *a)
+{
+    if (posixly_correct || a->next != NULL || a->ao_async)
+	return NULL;
+
+    const pipeline_T *p = a->ao_pipelines;
+    if (p->next != NULL || p->pl_neg)
+	return NULL;
+
+    const command_T *c = p->pl_commands;
+    if (c->next != NULL || c->c_type != CT_SIMPLE
+	    || c->c_assigns != NULL || c->c_words[0] != NULL)
+	return NULL;
+
+    const redir_T *r = c->c_redirs;
+    if (r == NULL || r->next != NULL
+	    || r->rd_type != RT_INPUT || r->rd_fd != STDIN_FILENO)
+	return NULL;
+    return r;
+}
+
+/* Substitutes the command substitution of the form "$(<file)" with the contents
+ * of the file, which is read in the current shell process rather than being
+ * copied by a subshell.
+ * If the filename can be expanded safely in the current shell process (see
+ * `is_safe_word'), the expanded filename is assigned to `*filenamep'. If the
+ * file is not a regular file, NULL is returned and the caller should fall back
+ * on a subshell that reads the file named `*filenamep'. The caller is
+ * responsible for freeing `*filenamep' in that case. */
+wchar_t *read_file_cmdsub_in_process(const redir_T *r, char **filenamep)
+{
+    if (!shopt_unset || !is_safe_word(r->rd_filename))
+	return NULL;
+
+    char *filename = expand_redir_filename(r->rd_filename);
+    if (filename == NULL) {
+	lastcmdsubstatus = Exit_REDIRERR;
+	return xwcsdup(L"");
+    }
+
+    /* Pipes and devices are read by a subshell, which can be interrupted. */
+    struct stat st;
+    int fd;
+    if (stat(filename, &st) < 0 || !S_ISREG(st.st_mode)
+	    || (fd = open(filename, O_RDONLY)) < 0) {
+	*filenamep = filename;
+	return NULL;
+    }
+    free(filename);
+
+    /* The file is decoded into at most as many wide characters as its size. */
+    xwcsbuf_T buf;
+    wb_init(&buf);
+    if (st.st_size > 0 && (uintmax_t) st.st_size < SIZE_MAX / sizeof (wchar_t))
+	wb_ensuremax(&buf, (size_t) st.st_size);
+    read_cmdsub_output(fd, &buf);
+    xclose(fd);
+    lastcmdsubstatus = Exit_SUCCESS;
+    return finish_cmdsub_output(&buf);
+}
+
+/* Copies the contents of the file to the standard output and exits the shell.
+ * This function is called in the subshell of the command substitution of the
+ * form "$(<file)". `r' is the redirection that specifies the file. If
+ * `filename' is non-NULL, it is used instead of expanding the filename of `r'.
+ */
+void copy_file_cmdsub(const redir_T *r, char *filename)
+{
+    if (filename == NULL) {
+	filename = expand_redir_filename(r->rd_filename);
+	if (filename == NULL)
+	    exit(Exit_REDIRERR);
+    }
+
+    int fd = open_file(filename, O_RDONLY);
+    if (fd < 0) {
+	xerror(errno, Ngt("redirection: cannot open file `%s'"), filename);
+	exit(Exit_REDIRERR);
+    }
+
+    char *block = xmalloc(CMDSUB_BLOCK_SIZE);
+    for (;;) {
+	ssize_t count = read(fd, block, CMDSUB_BLOCK_SIZE);
+	if (count < 0) {
+	    if (errno == EINTR)
+		continue;
+	    xerror(errno, Ngt("cannot read input"));
+	    exit(Exit_FAILURE);
+	}
+	if (count == 0)
+	    break;
+	if (!write_all(STDOUT_FILENO, block, (size_t) count))
+	    exit(Exit_FAILURE);
+    }
+    exit(Exit_SUCCESS);
+}
+
+/* Returns true if the commands of a command substitution can be executed in
+ * the current shell process rather than in a subshell.
+ * This is the case if the commands consist only of constructs that cannot
+ * affect the shell environment: the ":", "true", "false", "echo", "printf",
+ * "pwd", "test", and "[" built-ins, and functions that consist only of such
+ * constructs. Assignments, arithmetic expansions, parameter expansions that may
+ * assign or fail, external commands, and most redirections are not accepted.
+ * Options and traps that would make a command behave differently in a subshell
+ * also prevent in-process execution.
+ * Since none of the accepted constructs can define a function or change the
+ * command search path, command names resolved here remain valid during
+ * execution. */
+bool is_cmdsub_in_process_safe(const and_or_T *a)
+{
+    if (posixly_correct || any_trap_set)
+	return false;
+    if (!shopt_exec || !shopt_unset || shopt_errexit || shopt_errreturn)
+	return false;
+    return are_safe_and_or_lists(a, 0);
+}
+
+/* maximum nesting of function calls examined by `is_safe_simple_command' */
+#define CMDSUB_MAX_FUNCTION_DEPTH 8
+
+/* Returns true if the and-or lists are safe to execute in the current shell
+ * process (see `is_cmdsub_in_process_safe').
+ * `depth' is the number of function calls that lead to the commands. */
+bool are_safe_and_or_lists(const and_or_T *a, unsigned depth)
+{
+    for (; a != NULL; a = a->next) {
+	if (a->ao_async)
+	    return false;
+	for (const pipeline_T *p = a->ao_pipelines; p != NULL; p = p->next)
+	    if (p->pl_commands->next != NULL  /* multi-command pipeline */
+		    || !is_safe_command(p->pl_commands, depth))
+		return false;
+    }
+    return true;
+}
+
+/* Returns true if the command is safe to execute in the current shell process
+ * (see `is_cmdsub_in_process_safe'). */
+bool is_safe_command(const command_T *c, unsigned depth)
+{
+    /* The redirections of a subshell are performed in the child process. */
+    if (c->c_type != CT_SUBSHELL && !are_safe_redirections(c->c_redirs))
+	return false;
+
+    switch (c->c_type) {
+	case CT_SUBSHELL:
+	    return true;  /* executed in a child process anyway */
+	case CT_SIMPLE:
+	    return is_safe_simple_command(c, depth);
+	case CT_GROUP:
+	    return are_safe_and_or_lists(c->c_subcmds, depth);
+	case CT_IF:
+	    for (const ifcommand_T *ic = c->c_ifcmds; ic != NULL; ic = ic->next)
+		if (!are_safe_and_or_lists(ic->ic_condition, depth)
+			|| !are_safe_and_or_lists(ic->ic_commands, depth))
+		    return false;
+	    return true;
+	case CT_WHILE:
+	    return are_safe_and_or_lists(c->c_whlcond, depth)
+		&& are_safe_and_or_lists(c->c_whlcmds, depth);
+	case CT_CASE:
+	    if (!is_safe_word(c->c_casword))
+		return false;
+	    for (const caseitem_T *ci = c->c_casitems; ci != NULL;
+		    ci = ci->next)
+		if (!are_safe_words(ci->ci_patterns)
+			|| !are_safe_and_or_lists(ci->ci_commands, depth))
+		    return false;
+	    return true;
+	case CT_FOR:      /* assigns the loop variable */
+#if YASH_ENABLE_DOUBLE_BRACKET
+	case CT_BRACKET:
+#endif
+	case CT_FUNCDEF:  /* defines a function */
+	    return false;
+    }
+    assert(false);
+    return false;
+}
+
+/* Returns true if the simple command is safe to execute in the current shell
+ * process (see `is_cmdsub_in_process_safe'). The redirections of the command
+ * are not checked in this function. */
+bool is_safe_simple_command(const command_T *c, unsigned depth)
+{
+    if (c->c_assigns != NULL || !are_safe_words(c->c_words))
+	return false;
+
+    /* The command name must be a plain word so that it can be resolved before
+     * execution. */
+    const wordunit_T *name = c->c_words[0];
+    if (name == NULL)
+	return true;
+    if (name->next != NULL || name->wu_type != WT_STRING
+	    || wcspbrk(name->wu_string, L"\\\"'*?]{~") != NULL)
+	return false;
+
+    char *mbsname = malloc_wcstombs(name->wu_string);
+    if (mbsname == NULL)
+	return false;
+
+    commandinfo_T ci;
+    search_command(mbsname, name->wu_string, &ci, SCT_BUILTIN | SCT_FUNCTION);
+    free(mbsname);
+
+    switch (ci.type) {
+	case CT_FUNCTION:
+	    return depth < CMDSUB_MAX_FUNCTION_DEPTH
+		&& is_safe_command(ci.ci_function, depth + 1);
+	case CT_SPECIALBUILTIN:
+	    if (depth > 0 && wcscmp(name->wu_string, L"return") == 0)
+		return true;
+	    /* falls thru! */
+	case CT_SEMISPECIALBUILTIN:
+	case CT_REGULARBUILTIN:
+	    return wcscmp(name->wu_string, L":") == 0
+		|| wcscmp(name->wu_string, L"true") == 0
+		|| wcscmp(name->wu_string, L"false") == 0
+		|| wcscmp(name->wu_string, L"echo") == 0
+		|| wcscmp(name->wu_string, L"printf") == 0
+		|| wcscmp(name->wu_string, L"pwd") == 0
+		|| wcscmp(name->wu_string, L"test") == 0
+		|| wcscmp(name->wu_string, L"[") == 0;
+	case CT_NONE:
+	case CT_EXTERNALPROGRAM:
+	    return false;
+    }
+    assert(false);
+    return false;
+}
+
+/* Returns true if the redirections are safe to perform in the current shell
+ * process (see `is_cmdsub_in_process_safe'). Only here-documents,
+ * here-strings, duplication and closing of file descriptors, and redirections
+ * from and to "/dev/null" are accepted. */
+bool are_safe_redirections(const redir_T *r)
+{
+    for (; r != NULL; r = r->next) {
+	switch (r->rd_type) {
+	    case RT_INPUT:
+	    case RT_OUTPUT:
+	    case RT_CLOBBER:
+	    case RT_APPEND:
+	    case RT_INOUT:
+		if (!is_literal_word(r->rd_filename, L"/dev/null"))
+		    return false;
+		break;
+	    case RT_DUPIN:
+	    case RT_DUPOUT:;
+		const wordunit_T *w = r->rd_filename;
+		if (w == NULL || w->next != NULL || w->wu_type != WT_STRING)
+		    return false;
+		if (wcscmp(w->wu_string, L"-") != 0
+			&& (w->wu_string[0] == L'\0' || w->wu_string[
+				wcsspn(w->wu_string, L"0123456789")] != L'\0'))
+		    return false;
+		break;
+	    case RT_HERE:
+	    case RT_HERERT:
+		if (!is_safe_word(r->rd_herecontent))
+		    return false;
+		break;
+	    case RT_HERESTR:
+		if (!is_safe_word(r->rd_filename))
+		    return false;
+		break;
+	    case RT_PIPE:
+	    case RT_PROCIN:
+	    case RT_PROCOUT:
+		return false;
+	}
+    }
+    return true;
+}
+
+/* Returns true if all the words in the NULL-terminated array are safe to expand
+ * in the current shell process (see `is_safe_word'). */
+bool are_safe_words(void *const *words)
+{
+    for (; *words != NULL; words++)
+	if (!is_safe_word(*words))
+	    return false;
+    return true;
+}
+
+/* Returns true if the word is safe to expand in the current shell process.
+ * Expansions that may assign a variable or fail (and thus exit a
+ * non-interactive shell) are not safe. Nested command substitutions are safe
+ * since they are examined separately when executed. */
+bool is_safe_word(const wordunit_T *w)
+{
+    for (; w != NULL; w = w->next) {
+	switch (w->wu_type) {
+	    case WT_STRING:
+	    case WT_CMDSUB:
+		break;
+	    case WT_PARAM:;
+		const paramexp_T *p = w->wu_param;
+		switch (p->pe_type & PT_MASK) {
+		    case PT_ASSIGN:
+		    case PT_ERROR:
+			return false;
+		}
+		if (p->pe_start != NULL || p->pe_end != NULL)
+		    return false;
+		if (p->pe_type & PT_NEST) {
+		    if (!is_safe_word(p->pe_nest))
+			return false;
+		} else {
+		    /* $RANDOM updates the state of the random number
+		     * generator, which a subshell would not. */
+		    if (wcscmp(p->pe_name, L VAR_RANDOM) == 0)
+			return false;
+		}
+		if (!is_safe_word(p->pe_match) || !is_safe_word(p->pe_subst))
+		    return false;
+		break;
+	    case WT_ARITH:
+		return false;
+	}
+    }
+    return true;
+}
+
+/* Returns true if the word consists of the literal string `s' only. */
+bool is_literal_word(const wordunit_T *w, const wchar_t *s)
+{
+    return w != NULL && w->next == NULL && w->wu_type == WT_STRING
+	&& wcscmp(w->wu_string, s) == 0;
+}
+
+/* Executes the commands of a command substitution in the current shell process
+ * and returns the string to substitute with.
+ * The commands must have been approved by `is_cmdsub_in_process_safe'. The
+ * standard output is temporarily redirected to an unlinked temporary file,
+ * which is read after the commands finish.
+ * NULL is returned if the redirection cannot be prepared, in which case no
+ * command has been executed and the caller should fall back on a subshell. */
+wchar_t *exec_command_substitution_in_process(const and_or_T *a)
+{
+    char *tempfile;
+    int fd = create_temporary_file(&tempfile, "", 0);
+    if (fd < 0)
+	return NULL;
+    if (unlink(tempfile) < 0)
+	xerror(errno, Ngt("failed to remove temporary file `%s'"), tempfile);
+    free(tempfile);
+    fd = move_to_shellfd(fd);
+    if (fd < 0)
+	return NULL;
+
+    /* redirect the standard output to the temporary file */
+    fflush(stdout);
+    int savestdout = copy_as_shellfd(STDOUT_FILENO);
+    if ((savestdout < 0 && errno != EBADF)
+	    || xdup2(fd, STDOUT_FILENO) < 0) {
+	if (savestdout >= 0) {
+	    remove_shellfd(savestdout);
+	    xclose(savestdout);
+	}
+	remove_shellfd(fd);
+	xclose(fd);
+	return NULL;
+    }
+
+    /* execute the commands */
+    int savelaststatus = laststatus;
+    bool savesbe = special_builtin_executed;
+    const assign_T *savelastassign = last_assign;
+    execstate_T *saveexecstate = save_execstate();
+    reset_execstate(false);
+
+    exec_and_or_lists(a, false);
+
+    restore_execstate(saveexecstate);
+    last_assign = savelastassign;
+    special_builtin_executed = savesbe;
+    lastcmdsubstatus = laststatus;
+    laststatus = savelaststatus;
+
+    /* restore the standard output */
+    fflush(stdout);
+    clearerr(stdout);
+    if (savestdout >= 0) {
+	remove_shellfd(savestdout);
+	xdup2(savestdout, STDOUT_FILENO);
+	xclose(savestdout);
+    } else {
+	xclose(STDOUT_FILENO);
+    }
+
+    /* read the output */
+    xwcsbuf_T buf;
+    wb_init(&buf);
+    if (lseek(fd, 0, SEEK_SET) == 0)
+	read_cmdsub_output(fd, &buf);
+    remove_shellfd(fd);
+    xclose(fd);
+    return finish_cmdsub_output(&buf);
+}
+
+/* Reads the output of a command substitution from file descriptor `fd' until
+ * the end of file and appends it to `buf'.
+ * The output is read in large blocks and converted to wide characters block by
+ * block. Reading stops prematurely on a read error or an invalid multibyte
+ * sequence. */
+void read_cmdsub_output(int fd, xwcsbuf_T *buf)
+{
+    char *block = xmalloc(CMDSUB_BLOCK_SIZE);
+    bool asciicompat = is_ascii_compatible_encoding();
+    mbstate_t state;
+    memset(&state, 0, sizeof state);  /* initial shift state */
+
+    for (;;) {
+	ssize_t count = read(fd, block, CMDSUB_BLOCK_SIZE);
+	if (count < 0) {
+	    if (errno == EINTR)
+		continue;
+	    break;
+	}
+	if (count == 0)
+	    break;
+	if (wb_mbsncat(buf, block, (size_t) count, &state, asciicompat)
+		< (size_t) count)
+	    break;
+    }
+    free(block);
+}
+
+/* Removes trailing newlines from the output of a command substitution and
+ * returns the contents of the buffer, which is destroyed. */
+wchar_t *finish_cmdsub_output(xwcsbuf_T *buf)
+{
+    size_t len = buf->length;
+    while (len > 0 && buf->contents[len - 1] == L'\n')
+	len--;
+    return wb_towcs(wb_truncate(buf, len));
+}
+
 /* Executes commands in the given array of wide strings (iterative execution).
  * The strings are parsed and executed one by one.
  * If the iteration is interrupted by the "break -i" command, the remaining
@@ -2169,7 +2791,7 @@ int exec_builtin_2(int argc, void **argv, const wchar_t *as, bool clear)
 	}
 	envs = (char **) pl_toary(&list);
     } else {
-	envs = environ;
+	envs = get_environ();
     }
 
     exec_external_program(commandpath, argc, mbsargv0, argv, envs);
@@ -59,7 +59,9 @@ extern _Bool need_break(void)
 
 struct and_or_T;
 struct embedcmd_T;
+struct wordunit_T;
 extern void exec_and_or_lists(const struct and_or_T *a, _Bool finally_exit);
+extern _Bool is_safe_word(const struct wordunit_T *w);
 extern pid_t fork_and_reset(pid_t pgid, _Bool fg, sigtype_T sigtype);
 extern struct xwcsbuf_T *get_xtrace_buffer(void);
 extern wchar_t *exec_command_substitution(const struct embedcmd_T *cmdsub)
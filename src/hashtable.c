@@ -408,6 +408,14 @@ int keywcscoll(const void *k1, const void *k2)
     return wcscoll(((const kvpair_T *) k1)->key, ((const kvpair_T *) k2)->key);
 }
 
+/* Returns the wide-string key of the key-value pair.
+ * The argument is a pointer to a kvpair_T (const kvpair_T *).
+ * Can be used as the `keyof' argument to `sort_by_collation'. */
+const wchar_t *keywcs(const void *kv)
+{
+    return ((const kvpair_T *) kv)->key;
+}
+
 /* `Free's the key of the specified key-value pair.
  * Can be used as the freer function to `ht_clear'. */
 void kfree(kvpair_T kv)
@@ -90,6 +90,7 @@ extern hashval_T hashwcs(const void *s)             __attribute__((pure));
 extern int htwcscmp(const void *s1, const void *s2) __attribute__((pure));
 extern int keystrcoll(const void *kv1, const void *kv2) __attribute__((pure));
 extern int keywcscoll(const void *kv1, const void *kv2) __attribute__((pure));
+extern const wchar_t *keywcs(const void *kv) __attribute__((pure));
 extern void kfree(kvpair_T kv);
 extern void vfree(kvpair_T kv);
 extern void kvfree(kvpair_T kv);
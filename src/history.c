@@ -19,6 +19,7 @@
 #include "common.h"
 #include "history.h"
 #include <assert.h>
+#include <ctype.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <inttypes.h>
@@ -31,6 +32,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <time.h>
 #include <unistd.h>
@@ -38,15 +40,20 @@
 #include <wctype.h>
 #include "builtin.h"
 #include "exec.h"
+#include "hashtable.h"
 #include "job.h"
 #include "option.h"
 #include "path.h"
+#include "plist.h"
 #include "redir.h"
 #include "sig.h"
 #include "strbuf.h"
 #include "util.h"
 #include "variable.h"
 #include "yash.h"
+#if YASH_ENABLE_LINEEDIT
+# include "lineedit/editing.h"
+#endif
 
 
 /* The maximum size of history list (<= INT_MAX / 10) */
@@ -76,6 +83,15 @@
 #if DEFAULT_HISTSIZE > HISTORY_MIN_MAX_NUMBER
 #error DEFAULT_HISTSIZE cannot be larger than HISTORY_MIN_MAX_NUMBER
 #endif
+/* The size of memory chunks history entries are allocated in (in bytes) */
+#ifndef HISTORY_CHUNK_SIZE
+#define HISTORY_CHUNK_SIZE 4096
+#endif
+/* The history file is mapped into memory rather than read into a buffer when
+ * at least this many bytes are to be read. */
+#ifndef HISTORY_MMAP_THRESHOLD
+#define HISTORY_MMAP_THRESHOLD 65536
+#endif
 
 
 /* The main history list. */
@@ -88,6 +104,33 @@ histlist_T histlist = {
  * (`link.next') member points to the oldest entry. When there's no entries,
  * `Newest' and `Oldest' point to `histlist' itself. */
 
+/* The array of pointers to the entries in `histlist', which allows random
+ * access to the entries. The array is used as a ring buffer: the ith oldest
+ * entry (counting from zero) is at index (head + i) % capacity. The number of
+ * entries is `histlist.count'. */
+static struct {
+    histentry_T **entries;
+    size_t head, capacity;
+} histindex = { NULL, 0, 0, };
+
+/* The unit of memory in chunks, which is aligned suitably for `histentry_T'. */
+typedef union histunit_T {
+    histlink_T link;
+    unsigned number;
+    time_t time;
+    void *pointer;
+} histunit_T;
+/* A block of memory in which history entries are allocated. */
+typedef struct histchunk_T {
+    size_t entrycount;  /* number of entries in this chunk not yet freed */
+    size_t used, size;  /* numbers of used/all units in this chunk */
+    histunit_T units[];
+} histchunk_T;
+#define CHUNK_UNITS (HISTORY_CHUNK_SIZE / sizeof (histunit_T))
+/* The chunk in which new entries are allocated.
+ * Other chunks are freed when all the entries in them are freed. */
+static histchunk_T *current_chunk = NULL;
+
 /* The maximum limit of the number of an entry.
  * Must always be no less than `histsize' or `HISTORY_MIN_MAX_NUMBER'.
  * The number of any entry is not greater than this value. */
@@ -115,15 +158,51 @@ static time_t now = (time_t) -1;
 /* If true, the history is locked, that is, readonly. */
 static bool hist_lock = false;
 
+#if YASH_ENABLE_LINEEDIT
+/* A list of the entries whose values contain a trigram (a sequence of three
+ * bytes), from the oldest to the newest. The first `head' elements of
+ * `entries' are entries that have already been removed from the list. */
+typedef struct trigram_T {
+    uint_least32_t trigram;
+    size_t head;
+    plist_T entries;
+} trigram_T;
+/* The index of history entries by the trigrams in their values, used to find
+ * entries containing a substring without scanning the whole history.
+ * The keys are pointers to the `trigram' members of the `trigram_T' values.
+ * The index is built when it is first needed and then kept up to date as
+ * entries are added and removed while `trigramindex_built' is true. */
+static hashtable_T trigramindex;
+static bool trigramindex_built = false;
+#endif
+
 
 struct search_result_T {
     histlink_T *prev, *next;
 };
 
+/* A line in the history file that is being read. */
+struct linespan_T {
+    const char *line;
+    size_t length;
+};
+
 static void update_time(void);
 static void set_histsize(unsigned newsize);
-static histentry_T *new_entry(unsigned number, time_t time, const char *line)
+static histentry_T *alloc_entry(size_t valuelen)
+    __attribute__((warn_unused_result));
+static void free_entry(histentry_T *e)
     __attribute__((nonnull));
+static histentry_T **entry_at(size_t index)
+    __attribute__((pure));
+static unsigned normalize_number(unsigned number)
+    __attribute__((pure));
+static size_t search_index_by_number(unsigned nnumber)
+    __attribute__((pure));
+static histentry_T *new_entry(
+	unsigned number, time_t time, const char *value, size_t length)
+    __attribute__((nonnull));
+static void materialize_entries(void);
 static bool need_remove_entry(unsigned number)
     __attribute__((pure));
 static void remove_entry(histentry_T *e)
@@ -142,6 +221,24 @@ static bool search_result_is_newer(
 static bool entry_is_newer(const histentry_T *e1, const histentry_T *e2)
     __attribute__((nonnull,pure));
 
+#if YASH_ENABLE_LINEEDIT
+static hashval_T hashtrigram(const void *trigramp)
+    __attribute__((nonnull,pure));
+static int trigramcmp(const void *trigramp1, const void *trigramp2)
+    __attribute__((nonnull,pure));
+static uint_least32_t trigram_at(const char *s)
+    __attribute__((nonnull,pure));
+static void build_trigram_index(void);
+static void drop_trigram_index(void);
+static void free_trigram(kvpair_T kv);
+static void index_entry(histentry_T *e)
+    __attribute__((nonnull));
+static void unindex_entry(const histentry_T *e)
+    __attribute__((nonnull));
+static size_t search_trigram(const trigram_T *t, unsigned nnumber)
+    __attribute__((nonnull,pure));
+#endif
+
 static void add_histfile_pid(pid_t pid);
 static void remove_histfile_pid(pid_t pid);
 static void clear_histfile_pids(void);
@@ -153,14 +250,19 @@ static bool read_line(FILE *restrict f, xwcsbuf_T *restrict buf)
     __attribute__((nonnull));
 static bool try_read_line(FILE *restrict f, xwcsbuf_T *restrict buf)
     __attribute__((nonnull));
-static long read_signature(void);
+static long read_signature(off_t *endp)
+    __attribute__((nonnull));
 static void read_history_raw(void);
-static void read_history(void);
-static void parse_history_entry(const wchar_t *line)
+static bool read_history(off_t offset);
+static void parse_history_lines(
+	const char *restrict data, size_t length, bool defer)
+    __attribute__((nonnull));
+static void parse_history_entry(
+	const char *restrict line, const char *restrict end, bool defer)
     __attribute__((nonnull));
-static void parse_removed_entry(const wchar_t *numstr)
+static void parse_removed_entry(const char *numstr)
     __attribute__((nonnull));
-static void parse_process_id(const wchar_t *numstr)
+static void parse_process_id(const char *numstr)
     __attribute__((nonnull));
 static void update_history(bool refresh);
 static void maybe_refresh_file(void);
@@ -200,10 +302,111 @@ void set_histsize(unsigned newsize)
      * 2 * histsize. */
 }
 
+/* Allocates memory for a new history entry whose value is `valuelen' bytes
+ * long (not including the terminating null byte).
+ * The entry is allocated in `current_chunk' if it has enough room. */
+histentry_T *alloc_entry(size_t valuelen)
+{
+    size_t units = add(add(sizeof (histentry_T), valuelen),
+	    sizeof (histunit_T)) / sizeof (histunit_T);
+    histchunk_T *chunk = current_chunk;
+
+    if (chunk == NULL || chunk->size - chunk->used < units) {
+	size_t size = (units > CHUNK_UNITS) ? units : CHUNK_UNITS;
+	chunk = xmallocs(sizeof *chunk, size, sizeof *chunk->units);
+	chunk->entrycount = 0;
+	chunk->used = 0;
+	chunk->size = size;
+
+	/* A very long entry is allocated in a chunk of its own. */
+	if (units <= CHUNK_UNITS) {
+	    if (current_chunk != NULL && current_chunk->entrycount == 0)
+		free(current_chunk);
+	    current_chunk = chunk;
+	}
+    }
+
+    histentry_T *e = (histentry_T *) &chunk->units[chunk->used];
+    chunk->used += units;
+    chunk->entrycount++;
+    e->chunk = chunk;
+    return e;
+}
+
+/* Frees the history entry allocated by `alloc_entry'. */
+void free_entry(histentry_T *e)
+{
+    histchunk_T *chunk = e->chunk;
+    assert(chunk->entrycount > 0);
+    if (--chunk->entrycount == 0) {
+	if (chunk == current_chunk)
+	    chunk->used = 0;
+	else
+	    free(chunk);
+    }
+}
+
+/* Returns a pointer to the element of `histindex' that points to the entry at
+ * `index' counting from the oldest entry. */
+histentry_T **entry_at(size_t index)
+{
+    assert(index < histindex.capacity);
+    index += histindex.head;
+    if (index >= histindex.capacity)
+	index -= histindex.capacity;
+    return &histindex.entries[index];
+}
+
+/* Converts the entry number so that the numbers of the entries in the history
+ * list increase monotonically from the oldest to the newest even if the numbers
+ * have wrapped around. The history list must not be empty. */
+unsigned normalize_number(unsigned number)
+{
+    unsigned oldestnum = ashistentry(histlist.Oldest)->number;
+    unsigned newestnum = ashistentry(histlist.Newest)->number;
+    if (newestnum < oldestnum && number <= newestnum)
+	number += max_number;
+    return number;
+}
+
+/* Returns the index of the oldest entry whose normalized number is not less
+ * than `nnumber', which must be between the normalized numbers of the oldest
+ * and newest entries (inclusive).
+ * If no entries have been removed from the middle of the list since the last
+ * renumbering, the entry is found at the first guess. Otherwise, binary search
+ * is performed. */
+size_t search_index_by_number(unsigned nnumber)
+{
+    assert(histlist.count > 0);
+
+    size_t lo = 0, hi = histlist.count - 1;
+    size_t guess = nnumber - ashistentry(histlist.Oldest)->number;
+    if (guess < hi) {
+	unsigned n = normalize_number((*entry_at(guess))->number);
+	if (n == nnumber)
+	    return guess;
+	if (n < nnumber)
+	    lo = guess + 1;
+	else
+	    hi = guess;
+    }
+
+    while (lo < hi) {
+	size_t mid = lo + (hi - lo) / 2;
+	if (normalize_number((*entry_at(mid))->number) < nnumber)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+    return lo;
+}
+
 /* Adds a new history entry to the end of `histlist'.
+ * The value of the entry is the first `length' bytes of `value'.
  * Some oldest entries may be removed in this function if they conflict with the
  * new one or the list is full. */
-histentry_T *new_entry(unsigned number, time_t time, const char *line)
+histentry_T *new_entry(
+	unsigned number, time_t time, const char *value, size_t length)
 {
     assert(!hist_lock);
     assert(number > 0);
@@ -212,18 +415,36 @@ histentry_T *new_entry(unsigned number, time_t time, const char *line)
     while (need_remove_entry(number))
 	remove_entry(ashistentry(histlist.Oldest));
 
-    histentry_T *new = xmallocs(sizeof *new,
-	    add(strlen(line), 1), sizeof *new->value);
+    if (histindex.capacity < histsize) {
+	/* enlarge the ring buffer, moving the oldest entry to the start */
+	histentry_T **entries = xmallocn(histsize, sizeof *entries);
+	for (size_t i = 0; i < histlist.count; i++)
+	    entries[i] = *entry_at(i);
+	free(histindex.entries);
+	histindex.entries = entries;
+	histindex.head = 0;
+	histindex.capacity = histsize;
+    }
+
+    histentry_T *new = alloc_entry(length);
     new->Prev = histlist.Newest;
     new->Next = Histlist;
     histlist.Newest = new->Prev->next = &new->link;
     new->number = number;
     new->time = time;
-    strcpy(new->value, line);
+    memcpy(new->value, value, length);
+    new->value[length] = '\0';
 
+    *entry_at(histlist.count) = new;
     histlist.count++;
     assert(histlist.count <= histsize);
 
+#if YASH_ENABLE_LINEEDIT
+    if (trigramindex_built)
+	index_entry(new);
+    le_prediction_add_entry(new);
+#endif
+
     return new;
 }
 
@@ -247,10 +468,31 @@ void remove_entry(histentry_T *entry)
 {
     assert(!hist_lock);
     assert(&entry->link != Histlist);
+
+#if YASH_ENABLE_LINEEDIT
+    if (trigramindex_built)
+	unindex_entry(entry);
+    le_prediction_remove_entry(entry);
+#endif
+
+    /* remove the entry from `histindex', moving the shorter side of the
+     * entries to fill the gap */
+    size_t index = search_index_by_number(normalize_number(entry->number));
+    assert(*entry_at(index) == entry);
+    if (index < histlist.count / 2) {
+	for (size_t i = index; i > 0; i--)
+	    *entry_at(i) = *entry_at(i - 1);
+	if (++histindex.head == histindex.capacity)
+	    histindex.head = 0;
+    } else {
+	for (size_t i = index + 1; i < histlist.count; i++)
+	    *entry_at(i - 1) = *entry_at(i);
+    }
+
     entry->Prev->next = entry->Next;
     entry->Next->prev = entry->Prev;
     histlist.count--;
-    free(entry);
+    free_entry(entry);
 }
 
 /* Removes the newest entry. */
@@ -281,11 +523,47 @@ void clear_all_entries(void)
     histlink_T *l = histlist.Oldest;
     while (l != Histlist) {
 	histlink_T *next = l->next;
-	free(ashistentry(l));
+	free_entry(ashistentry(l));
 	l = next;
     }
     histlist.Oldest = histlist.Newest = Histlist;
     histlist.count = 0;
+    histindex.head = 0;
+
+#if YASH_ENABLE_LINEEDIT
+    drop_trigram_index();
+    le_prediction_forget_entries();
+#endif
+}
+
+/* Replaces all the entries in `histlist' with new ones whose values are the
+ * lines referred to by the values of the old entries.
+ * This function is used after `read_history' read the entire history file:
+ * each entry's value is a `struct linespan_T' until this function is called
+ * so that only the values of the entries that remain in the list are copied. */
+void materialize_entries(void)
+{
+    histlink_T *prev = Histlist;
+    for (size_t i = 0; i < histlist.count; i++) {
+	histentry_T **slot = entry_at(i);
+	histentry_T *old = *slot;
+	struct linespan_T span;
+	memcpy(&span, old->value, sizeof span);
+
+	histentry_T *new = alloc_entry(span.length);
+	new->Prev = prev;
+	prev->next = &new->link;
+	new->number = old->number;
+	new->time = old->time;
+	memcpy(new->value, span.line, span.length);
+	new->value[span.length] = '\0';
+	prev = &new->link;
+
+	*slot = new;
+	free_entry(old);
+    }
+    prev->next = Histlist;
+    histlist.Newest = prev;
 }
 
 /* Searches for the entry that has the specified `number'.
@@ -304,13 +582,9 @@ struct search_result_T search_entry_by_number(unsigned number)
     }
 
     unsigned oldestnum = ashistentry(histlist.Oldest)->number;
-    unsigned nnewestnum = ashistentry(histlist.Newest)->number;
-    unsigned nnumber = number;
-    if (nnewestnum < oldestnum) {
-	if (nnumber <= nnewestnum)
-	    nnumber += max_number;
-	nnewestnum += max_number;
-    }
+    unsigned nnewestnum = normalize_number(
+	    ashistentry(histlist.Newest)->number);
+    unsigned nnumber = normalize_number(number);
     if (nnumber < oldestnum) {
 	result.prev = Histlist;
 	result.next = histlist.Oldest;
@@ -321,30 +595,10 @@ struct search_result_T search_entry_by_number(unsigned number)
 	return result;
     }
 
-    histlink_T *l;
-    if (2 * (nnumber - oldestnum) < nnewestnum - oldestnum) {
-	/* search from the oldest */
-	l = histlist.Oldest;
-	while (number < ashistentry(l)->number)
-	    l = l->next;
-	while (number > ashistentry(l)->number)
-	    l = l->next;
-	result.next = l;
-	if (number != ashistentry(l)->number)
-	    l = l->prev;
-	result.prev = l;
-    } else {
-	/* search from the newest */
-	l = histlist.Newest;
-	while (number > ashistentry(l)->number)
-	    l = l->prev;
-	while (number < ashistentry(l)->number)
-	    l = l->prev;
-	result.prev = l;
-	if (number != ashistentry(l)->number)
-	    l = l->next;
-	result.next = l;
-    }
+    size_t index = search_index_by_number(nnumber);
+    histentry_T *e = *entry_at(index);
+    result.next = &e->link;
+    result.prev = (e->number == number) ? &e->link : e->Prev;
     return result;
 }
 
@@ -354,11 +608,9 @@ histlink_T *get_nth_newest_entry(unsigned n)
 {
     if (histlist.count <= n)
 	return histlist.Oldest;
-
-    histlink_T *l = Histlist;
-    while (n-- > 0)
-	l = l->prev;
-    return l;
+    if (n == 0)
+	return Histlist;
+    return &(*entry_at(histlist.count - n))->link;
 }
 
 /* Searches for the newest entry whose value begins with the specified `prefix'.
@@ -401,6 +653,136 @@ bool entry_is_newer(const histentry_T *e1, const histentry_T *e2)
 	|| (n2 <= n1 && (oldest <= n2 || n1 <= newest));
 }
 
+#if YASH_ENABLE_LINEEDIT
+
+/* Hash function for `trigramindex'. */
+hashval_T hashtrigram(const void *trigramp)
+{
+    return (hashval_T) *(const uint_least32_t *) trigramp * FNVPRIME;
+}
+
+/* Comparison function for `trigramindex'. */
+int trigramcmp(const void *trigramp1, const void *trigramp2)
+{
+    return *(const uint_least32_t *) trigramp1
+	!= *(const uint_least32_t *) trigramp2;
+}
+
+/* Returns the trigram at the beginning of `s', which must be at least three
+ * bytes long. */
+uint_least32_t trigram_at(const char *s)
+{
+    return (uint_least32_t) (unsigned char) s[0] << 16
+	| (uint_least32_t) (unsigned char) s[1] << 8
+	| (uint_least32_t) (unsigned char) s[2];
+}
+
+/* Builds `trigramindex' from all the entries in `histlist' unless it is
+ * already built. */
+void build_trigram_index(void)
+{
+    if (trigramindex_built)
+	return;
+
+    ht_init(&trigramindex, hashtrigram, trigramcmp);
+    trigramindex_built = true;
+    for (histlink_T *l = histlist.Oldest; l != Histlist; l = l->next)
+	index_entry(ashistentry(l));
+}
+
+/* Frees `trigramindex'. It will be rebuilt when it is needed again. */
+void drop_trigram_index(void)
+{
+    if (trigramindex_built) {
+	ht_clear(&trigramindex, free_trigram);
+	ht_destroy(&trigramindex);
+	trigramindex_built = false;
+    }
+}
+
+/* Frees the `trigram_T' value of a `trigramindex' entry. */
+void free_trigram(kvpair_T kv)
+{
+    trigram_T *t = kv.value;
+    pl_destroy(&t->entries);
+    free(t);
+}
+
+/* Adds `e' to `trigramindex'. `e' must be the newest entry. */
+void index_entry(histentry_T *e)
+{
+    const char *s = e->value;
+    if (s[0] == '\0' || s[1] == '\0')
+	return;
+    for (; s[2] != '\0'; s++) {
+	uint_least32_t key = trigram_at(s);
+	trigram_T *t = ht_get(&trigramindex, &key).value;
+	if (t == NULL) {
+	    t = xmalloc(sizeof *t);
+	    t->trigram = key;
+	    t->head = 0;
+	    pl_init(&t->entries);
+	    ht_set(&trigramindex, &t->trigram, t);
+	} else if (t->entries.contents[t->entries.length - 1] == e) {
+	    continue;  /* the trigram appeared earlier in the value */
+	}
+	pl_add(&t->entries, e);
+    }
+}
+
+/* Removes `e' from `trigramindex'. `e' must still be in `histlist'. */
+void unindex_entry(const histentry_T *e)
+{
+    unsigned nnumber = normalize_number(e->number);
+    const char *s = e->value;
+    if (s[0] == '\0' || s[1] == '\0')
+	return;
+    for (; s[2] != '\0'; s++) {
+	uint_least32_t key = trigram_at(s);
+	trigram_T *t = ht_get(&trigramindex, &key).value;
+	if (t == NULL)
+	    continue;
+
+	plist_T *list = &t->entries;
+	size_t index = search_trigram(t, nnumber);
+	if (index == list->length || list->contents[index] != e)
+	    continue;  /* the trigram appeared earlier in the value */
+	if (index == t->head)
+	    t->head++;
+	else
+	    pl_remove(list, index, 1);
+
+	if (t->head == list->length) {
+	    ht_remove(&trigramindex, &key);
+	    free_trigram((kvpair_T) { &t->trigram, t, });
+	} else if (t->head > list->length / 2) {
+	    pl_remove(list, 0, t->head);
+	    t->head = 0;
+	}
+    }
+}
+
+/* Returns the index of the first element of `t->entries' (not less than
+ * `t->head') whose normalized number is not less than `nnumber'. */
+size_t search_trigram(const trigram_T *t, unsigned nnumber)
+{
+    size_t lo = t->head, hi = t->entries.length;
+    const histentry_T *first = t->entries.contents[lo];
+    if (normalize_number(first->number) >= nnumber)
+	return lo;
+    while (lo < hi) {
+	size_t mid = lo + (hi - lo) / 2;
+	const histentry_T *e = t->entries.contents[mid];
+	if (normalize_number(e->number) < nnumber)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+    return lo;
+}
+
+#endif /* YASH_ENABLE_LINEEDIT */
+
 
 /********** Process ID list **********/
 
@@ -635,31 +1017,39 @@ bool try_read_line(FILE *restrict f, xwcsbuf_T *restrict buf)
 /* Reads the signature of the history file (`histfile') and checks if it is a
  * valid signature.
  * If valid:
- *   - the file is positioned just after the signature,
+ *   - `*endp' is assigned the offset just after the signature,
  *   - the return value is the revision of the file (non-negative).
  * Otherwise:
- *   - the file position is undefined,
- *   - the return value is negative. */
+ *   - `*endp' is unspecified,
+ *   - the return value is negative.
+ * The position of `histfile' is not changed. */
 /* The history file should be locked. */
-long read_signature(void)
+long read_signature(off_t *endp)
 {
-    xwcsbuf_T buf;
-    long rev = -1;
-    const wchar_t *s;
+    static const char prefix[] = "#$# yash history v0 r";
+    char buf[sizeof prefix + 24];
+    ssize_t size;
 
     assert(histfile != NULL);
-    rewind(histfile);
-    if (!read_line(histfile, wb_init(&buf)))
-	goto end;
-    
-    s = matchwcsprefix(buf.contents, L"#$# yash history v0 r");
-    if (s == NULL || !iswdigit(s[0]))
-	goto end;
+    while ((size = pread(fileno(histfile), buf, sizeof buf - 1, 0)) < 0)
+	if (errno != EINTR)
+	    return -1;
 
-    if (!xwcstol(s, 10, &rev))
-	rev = -1;
-end:
-    wb_destroy(&buf);
+    char *newline = memchr(buf, '\n', (size_t) size);
+    if (newline == NULL)
+	return -1;
+    *newline = '\0';
+    *endp = newline - buf + 1;
+
+    const char *s = matchstrprefix(buf, prefix);
+    if (s == NULL || !isdigit((unsigned char) s[0]))
+	return -1;
+
+    char *end;
+    errno = 0;
+    long rev = strtol(s, &end, 10);
+    if (errno != 0 || *end != '\0')
+	return -1;
     return rev;
 }
 
@@ -679,7 +1069,7 @@ void read_history_raw(void)
     while (read_line(histfile, &buf)) {
 	char *line = malloc_wcstombs(buf.contents);
 	if (line != NULL) {
-	    new_entry(next_history_number(), -1, line);
+	    new_entry(next_history_number(), -1, line, strlen(line));
 	    free(line);
 	}
 	wb_clear(&buf);
@@ -687,62 +1077,139 @@ void read_history_raw(void)
     wb_destroy(&buf);
 }
 
-/* Reads history entries from the history file.
- * The file is read from the current position.
+/* Reads history entries from the history file, starting at `offset'.
  * The entries that were read from the file are appended to `histlist'.
- * `update_time' must be called before calling this function. */
+ * The file is read to the end and `histfile' is positioned at the end so that
+ * new entries can be written just after the entries read.
+ * A large part of the file is mapped into memory and scanned without decoding
+ * it into wide characters.
+ * If `histlist' is empty when this function is called, which is the case when
+ * the whole file is read, the values of the entries are copied only for those
+ * that remain in the list after all the lines have been parsed.
+ * `update_time' must be called before calling this function.
+ * Returns false on error. */
 /* The file should be locked. */
-/* This function does not return any error status. The caller should check
- * `ferror' and/or `feof' for the file. */
-void read_history(void)
+bool read_history(off_t offset)
 {
-    xwcsbuf_T buf;
+    int fd = fileno(histfile);
+    struct stat st;
 
     assert(histfile != NULL);
-    wb_init(&buf);
-    while (read_line(histfile, &buf)) {
+    if (fstat(fd, &st) < 0)
+	return false;
+    if (st.st_size <= offset)
+	goto end;
+    if ((uintmax_t) (st.st_size - offset) > SIZE_MAX)
+	return false;
+
+    size_t length = (size_t) (st.st_size - offset);
+    bool defer = (histlist.count == 0);
+
+    if (length >= HISTORY_MMAP_THRESHOLD) {
+	/* The mapping must start at a page boundary. */
+	long pagesize = sysconf(_SC_PAGESIZE);
+	off_t skip = (pagesize > 0) ? offset % pagesize : 0;
+	void *map = mmap(NULL, length + skip, PROT_READ, MAP_PRIVATE,
+		fd, offset - skip);
+	if (map != MAP_FAILED) {
+	    parse_history_lines((char *) map + skip, length, defer);
+	    munmap(map, length + skip);
+	    goto end;
+	}
+    }
+
+    char *buf = xmalloc(length);
+    size_t n = 0;
+    while (n < length) {
+	ssize_t count = pread(fd, &buf[n], length - n, offset + n);
+	if (count < 0) {
+	    if (errno == EINTR)
+		continue;
+	    free(buf);
+	    return false;
+	}
+	if (count == 0)
+	    break;
+	n += count;
+    }
+    parse_history_lines(buf, n, defer);
+    free(buf);
+
+end:
+    return fseeko(histfile, st.st_size, SEEK_SET) == 0;
+}
+
+/* Parses the lines of the history file in `data', which is `length' bytes long.
+ * A line that is not terminated by a newline is ignored. So are very long
+ * lines.
+ * If `defer' is true, the values of the entries are not copied (see
+ * `materialize_entries'), so `data' must be valid until `materialize_entries'
+ * is called. */
+void parse_history_lines(const char *restrict data, size_t length, bool defer)
+{
+    const char *end = data + length;
+    const char *line, *newline;
+
+#if YASH_ENABLE_LINEEDIT
+    /* The placeholder values of deferred entries must not be indexed. */
+    if (defer) {
+	drop_trigram_index();
+	le_prediction_forget_entries();
+    }
+#endif
+
+    for (line = data;
+	    (newline = memchr(line, '\n', end - line)) != NULL;
+	    line = newline + 1) {
+	if (newline - line > LINE_MAX)
+	    continue;
+
 	histfilelines++;
-	switch (buf.contents[0]) {
-	    case L'0': case L'1': case L'2': case L'3': case L'4':
-	    case L'5': case L'6': case L'7': case L'8': case L'9':
-	    case L'A': case L'B': case L'C': case L'D': case L'E': case L'F':
-		parse_history_entry(buf.contents);
+	switch (line[0]) {
+	    case '0': case '1': case '2': case '3': case '4':
+	    case '5': case '6': case '7': case '8': case '9':
+	    case 'A': case 'B': case 'C': case 'D': case 'E': case 'F':
+		parse_history_entry(line, newline, defer);
 		break;
-	    case L'c':
+	    case 'c':
 		remove_last_entry();
 		break;
-	    case L'd':
-		parse_removed_entry(buf.contents + 1);
+	    case 'd':
+		parse_removed_entry(line + 1);
 		break;
-	    case L'p':
-		parse_process_id(buf.contents + 1);
+	    case 'p':
+		parse_process_id(line + 1);
 		break;
 	}
-	wb_clear(&buf);
     }
-    wb_destroy(&buf);
+
+    if (defer)
+	materialize_entries();
 }
 
-void parse_history_entry(const wchar_t *line)
+/* Parses a history entry line, which starts at `line' and ends at `end'.
+ * The character at `end' must be a newline. */
+void parse_history_entry(
+	const char *restrict line, const char *restrict end, bool defer)
 {
     unsigned long num;
     time_t time;
-    wchar_t *end;
-    char *value;
+    char *numend;
 
-    assert(iswxdigit(line[0]));
+    assert(isxdigit((unsigned char) line[0]));
+    assert(*end == '\n');
 
     errno = 0;
-    num = wcstoul(line, &end, 0x10);
-    if (errno || end[0] == L'\0' || num > max_number)
+    num = strtoul(line, &numend, 0x10);
+    if (errno || numend == end || num > max_number)
 	return;
 
-    if (end[0] == L':' && iswxdigit(end[1])) {
+    if (numend[0] == ':' && isxdigit((unsigned char) numend[1])) {
 	unsigned long long t;
 
 	errno = 0;
-	t = wcstoull(&end[1], &end, 0x10);
-	if (errno || end[0] == L'\0')
+	t = strtoull(&numend[1], &numend, 0x10);
+	if (errno || numend == end)
 	    time = -1;
 	else if (t > (unsigned long long) now)
 	    time = now;
@@ -752,28 +1219,35 @@ void parse_history_entry(const wchar_t *line)
 	time = -1;
     }
 
-    if (!iswspace(end[0]))
+    if (numend == end || !isspace((unsigned char) numend[0]))
 	return;
-    value = malloc_wcstombs(&end[1]);
-    if (value != NULL) {
-	new_entry((unsigned) num, time, value);
-	free(value);
+
+    /* The value ends at the newline or the first null byte, if any. */
+    const char *value = &numend[1];
+    const char *nul = memchr(value, '\0', end - value);
+    size_t length = (size_t) ((nul != NULL ? nul : end) - value);
+
+    if (defer) {
+	struct linespan_T span = { .line = value, .length = length, };
+	new_entry((unsigned) num, time, (const char *) &span, sizeof span);
+    } else {
+	new_entry((unsigned) num, time, value, length);
     }
 }
 
-void parse_removed_entry(const wchar_t *numstr)
+void parse_removed_entry(const char *numstr)
 {
     unsigned long num;
-    wchar_t *end;
+    char *end;
 
     if (histlist.count == 0)
 	return;
-    if (numstr[0] == L'\0')
+    if (isspace((unsigned char) numstr[0]))
 	return;
 
     errno = 0;
-    num = wcstoul(numstr, &end, 0x10);
-    if (errno || (*end != L'\0' && !iswspace(*end)))
+    num = strtoul(numstr, &end, 0x10);
+    if (errno || !isspace((unsigned char) *end))
 	return;
     if (num > max_number)
 	return;
@@ -783,17 +1257,17 @@ void parse_removed_entry(const wchar_t *numstr)
 	remove_entry(ashistentry(sr.prev));
 }
 
-void parse_process_id(const wchar_t *numstr)
+void parse_process_id(const char *numstr)
 {
     intmax_t num;
-    wchar_t *end;
+    char *end;
 
-    if (numstr[0] == L'\0')
+    if (isspace((unsigned char) numstr[0]))
 	return;
 
     errno = 0;
-    num = wcstoimax(numstr, &end, 10);
-    if (errno || (*end != L'\0' && !iswspace(*end)))
+    num = strtoimax(numstr, &end, 10);
+    if (errno || !isspace((unsigned char) *end))
 	return;
     if (num > 0)
 	add_histfile_pid((pid_t) num);
@@ -806,6 +1280,8 @@ void parse_process_id(const wchar_t *numstr)
  * Changes that have been made to the file by other shell processes are brought
  * into this shell's history. The current data in this shell's history may be
  * changed.
+ * If the revision of the file has not been changed, only the part of the file
+ * after the current position is read.
  * If `refresh' is true, this function may call `refresh_file'.
  * On failure, `histfile' is closed and set to NULL.
  * `update_time' must be called before calling this function.
@@ -816,26 +1292,23 @@ void parse_process_id(const wchar_t *numstr)
  * This function must be called just before writing to the history file. */
 void update_history(bool refresh)
 {
-    bool posfail;
-    fpos_t pos;
+    off_t pos, sigend;
     long rev;
 
     if (histfile == NULL)
 	return;
     assert(!hist_lock);
 
-#if WIO_BROKEN
-    posfail = true;
-#else
-    posfail = fgetpos(histfile, &pos);
-#endif
-    rev = read_signature();
+    /* The stream has no buffered data since it is flushed when unlocked, so
+     * the offset of the file descriptor is the current position. */
+    pos = lseek(fileno(histfile), 0, SEEK_CUR);
+    rev = read_signature(&sigend);
     if (rev < 0)
 	goto error;
-    if (!posfail && rev == histfilerev) {
+    if (pos >= sigend && rev == histfilerev) {
 	/* The revision has not been changed. Just read new entries. */
-	fsetpos(histfile, &pos);
-	read_history();
+	if (!read_history(pos))
+	    goto error;
     } else {
 	/* The revision has been changed. Re-read everything. */
 	clear_all_entries();
@@ -843,10 +1316,9 @@ void update_history(bool refresh)
 	add_histfile_pid(shell_pid);
 	histfilerev = rev;
 	histfilelines = 0;
-	read_history();
+	if (!read_history(sigend))
+	    goto error;
     }
-    if (ferror(histfile) || !feof(histfile))
-	goto error;
 
     if (refresh)
 	maybe_refresh_file();
@@ -969,14 +1441,14 @@ void maybe_init_history(void)
     histfile = open_histfile();
     if (histfile != NULL) {
 	lock_histfile(F_WRLCK);
-	histfilerev = read_signature();
+	off_t sigend;
+	histfilerev = read_signature(&sigend);
 	if (histfilerev < 0) {
 	    rewind(histfile);
 	    read_history_raw();
 	    goto refresh;
 	}
-	read_history();
-	if (ferror(histfile) || !feof(histfile)) {
+	if (!read_history(sigend)) {
 	    close_history_file();
 	    return;
 	}
@@ -1101,7 +1573,7 @@ void add_history_line(const wchar_t *line, size_t maxlen)
 	histentry_T *entry;
 
 	remove_duplicates(mbsline);
-	entry = new_entry(next_history_number(), now, mbsline);
+	entry = new_entry(next_history_number(), now, mbsline, strlen(mbsline));
 	if (histfile != NULL)
 	    write_history_entry(entry);
 	free(mbsline);
@@ -1161,6 +1633,66 @@ void end_using_history(void)
     hist_lock = false;
 }
 
+/* Searches for an entry whose value contains `substr', starting from the entry
+ * next to `l' in the direction of the oldest entry (if `backward') or the
+ * newest entry (otherwise). If `l' is `Histlist', the search starts from the
+ * newest (if `backward') or oldest (otherwise) entry.
+ * Returns `Histlist' if not found.
+ * The search is narrowed down by `trigramindex' if `substr' is at least three
+ * bytes long. */
+const histlink_T *search_history_substring(
+	const histlink_T *l, bool backward, const char *substr)
+{
+    if (substr[0] == '\0' || substr[1] == '\0' || substr[2] == '\0')
+	goto linear_search;
+
+    build_trigram_index();
+
+    /* choose the trigram contained in the fewest entries */
+    const trigram_T *rarest = NULL;
+    for (const char *s = substr; s[2] != '\0'; s++) {
+	uint_least32_t key = trigram_at(s);
+	const trigram_T *t = ht_get(&trigramindex, &key).value;
+	if (t == NULL)
+	    return Histlist;
+	if (rarest == NULL || t->entries.length - t->head
+		< rarest->entries.length - rarest->head)
+	    rarest = t;
+    }
+
+    void *const *entries = rarest->entries.contents;
+    size_t head = rarest->head, length = rarest->entries.length;
+    size_t index;
+    if (l == Histlist) {
+	index = backward ? length : head;
+    } else {
+	unsigned nnumber = normalize_number(ashistentry(l)->number);
+	index = search_trigram(rarest, nnumber);
+	if (!backward && index < length && entries[index] == l)
+	    index++;
+    }
+    if (backward) {
+	while (index > head) {
+	    const histentry_T *e = entries[--index];
+	    if (strstr(e->value, substr) != NULL)
+		return &e->link;
+	}
+    } else {
+	for (; index < length; index++) {
+	    const histentry_T *e = entries[index];
+	    if (strstr(e->value, substr) != NULL)
+		return &e->link;
+	}
+    }
+    return Histlist;
+
+linear_search:
+    do
+	l = backward ? l->prev : l->next;
+    while (l != Histlist && strstr(ashistentry(l)->value, substr) == NULL);
+    return l;
+}
+
 #endif /* YASH_ENABLE_LINEEDIT */
 
 
@@ -1435,6 +1967,7 @@ int fc_print_entries(
     else
 	start = last, end = first;
     e = start;
+    flush_stdout();
     for (;;) {
 	int r;
 	switch (type) {
@@ -1505,8 +2038,10 @@ int fc_exec_entry(const histentry_T *entry,
     }
 
     add_history(code);
-    if (!quiet)
+    if (!quiet) {
+	flush_stdout();
 	printf("%ls\n", code);
+    }
     exec_wcs(code, "fc", false);
     free(code);
     return laststatus;
@@ -1607,6 +2142,7 @@ void fc_read_history(FILE *f, bool quiet)
     update_history(false);
 
     wb_init(&buf);
+    flush_stdout();
     while (read_line(f, &buf)) {
 	if (!quiet)
 	    printf("%ls\n", buf.contents);
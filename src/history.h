@@ -36,6 +36,7 @@ typedef struct histentry_T {
     histlink_T link;
     unsigned number;
     time_t time;
+    struct histchunk_T *chunk;
     char value[];
 } histentry_T;
 #define Prev link.prev
@@ -48,6 +49,7 @@ typedef struct histentry_T {
  * The limit is no less than $HISTSIZE, so all the entries have different
  * numbers anyway. */
 /* When the time is unknown, `time' is -1. */
+/* The `chunk' is the block of memory the entry is allocated in. */
 
 /* The structure type of the history list. */
 typedef struct histlist_T {
@@ -81,6 +83,9 @@ const histlink_T *get_history_entry(unsigned number)
 #if YASH_ENABLE_LINEEDIT
 extern void start_using_history(void);
 extern void end_using_history(void);
+extern const histlink_T *search_history_substring(
+	const histlink_T *l, _Bool backward, const char *substr)
+    __attribute__((nonnull));
 #endif
 
 extern int fc_builtin(int argc, void **argv)
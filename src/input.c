@@ -41,6 +41,8 @@
 #include "mail.h"
 #include "option.h"
 #include "parser.h"
+#include "path.h"
+#include "redir.h"
 #include "sig.h"
 #include "strbuf.h"
 #include "util.h"
@@ -109,7 +111,7 @@ inputresult_T input_file(struct xwcsbuf_T *buf, void *inputinfo)
 inputresult_T read_input(
 	xwcsbuf_T *buf, struct input_file_info_T *info, bool trap)
 {
-    if (info->bufsize == 1 && is_seekable_file(info->fd))
+    if (!info->readahead && is_seekable_file(info->fd))
 	return optimized_read_input(buf, info, trap);
 
     size_t initlen = buf->length;
@@ -118,37 +120,17 @@ inputresult_T read_input(
     for (;;) {
 	if (info->bufpos >= info->bufmax) {
 read_input:  /* if there's nothing in the buffer, read the next input */
-	    switch (wait_for_input(info->fd, trap, -1)) {
-		case W_READY:
+	    switch (fill_input_buffer(info, trap)) {
+		case INPUT_OK:
 		    break;
-		case W_TIMED_OUT:
+		case INPUT_EOF:
+		    goto end;
+		case INPUT_INTERRUPTED:
 		    assert(false);
-		case W_INTERRUPTED:
-		    // Ignore interruption and continue reading, because:
-		    //  1) POSIX does not require to handle interruption, and
-		    //  2) the buffer for canonical-mode editing cannot be
-		    //     controlled from the shell.
-		    goto read_input;
-		case W_ERROR:
+		case INPUT_ERROR:
 		    status = INPUT_ERROR;
 		    goto end;
 	    }
-
-	    ssize_t readcount = read(info->fd, info->buf, info->bufsize);
-	    if (readcount < 0) switch (errno) {
-		case EINTR:
-		case EAGAIN:
-#if EAGAIN != EWOULDBLOCK
-		case EWOULDBLOCK:
-#endif
-		    goto read_input;  /* try again */
-		default:
-		    goto error;
-	    } else if (readcount == 0) {
-		goto end;
-	    }
-	    info->bufpos = 0;
-	    info->bufmax = readcount;
 	}
 
 	/* convert bytes in `info->buf' into a wide character and
@@ -184,6 +166,58 @@ end:
 	return status;
 }
 
+/* Reads the next input from file descriptor `info->fd' into `info->buf',
+ * replacing the current contents of the buffer. Only one byte is read unless
+ * `info->readahead' is true.
+ * If `trap' is true, traps are handled while waiting for input.
+ * Returns:
+ *   INPUT_OK    if at least one byte was read
+ *   INPUT_EOF   if reached the end of file
+ *   INPUT_ERROR if an error occurred */
+inputresult_T fill_input_buffer(struct input_file_info_T *info, bool trap)
+{
+    for (;;) {
+	/* If the buffered output of built-ins is pending, first check if the
+	 * input is readable without waiting. The output must be flushed before
+	 * the shell blocks because the input may be a response to the output
+	 * (as in a coprocess). */
+	int timeout = stdout_buffer_pending() ? 0 : -1;
+	switch (wait_for_input(info->fd, trap, timeout)) {
+	    case W_READY:
+		break;
+	    case W_TIMED_OUT:
+		assert(timeout == 0);
+		flush_stdout();
+		continue;
+	    case W_INTERRUPTED:
+		// Ignore interruption and continue reading, because:
+		//  1) POSIX does not require to handle interruption, and
+		//  2) the buffer for canonical-mode editing cannot be
+		//     controlled from the shell.
+		continue;
+	    case W_ERROR:
+		return INPUT_ERROR;
+	}
+
+	ssize_t readcount = read(info->fd, info->buf,
+		info->readahead ? info->bufsize : 1);
+	if (readcount < 0) switch (errno) {
+	    case EINTR:
+	    case EAGAIN:
+#if EAGAIN != EWOULDBLOCK
+	    case EWOULDBLOCK:
+#endif
+		continue;  /* try again */
+	    default:
+		xerror(errno, Ngt("cannot read input"));
+		return INPUT_ERROR;
+	}
+	info->bufpos = 0;
+	info->bufmax = readcount;
+	return (readcount > 0) ? INPUT_OK : INPUT_EOF;
+    }
+}
+
 /* Checks if the file descriptor is seekable. */
 bool is_seekable_file(int fd)
 {
@@ -195,7 +229,7 @@ bool is_seekable_file(int fd)
 }
 
 /* Works like `read_input', but improves performance by reading many bytes at
- * once even if `info->bufsize' is 1. The input file descriptor must be
+ * once even if `info->readahead' is false. The input file descriptor must be
  * seekable. */
 inputresult_T optimized_read_input(
 	struct xwcsbuf_T *buf, struct input_file_info_T *info, _Bool trap)
@@ -206,26 +240,43 @@ inputresult_T optimized_read_input(
     tmpinfo->state = info->state;
     tmpinfo->bufpos = tmpinfo->bufmax = 0;
     tmpinfo->bufsize = BUFSIZ;
+    tmpinfo->readahead = true;
 
     while (info->bufpos < info->bufmax)
 	tmpinfo->buf[tmpinfo->bufmax++] = info->buf[info->bufpos++];
 
     inputresult_T result = read_input(buf, tmpinfo, trap);
 
-    if (tmpinfo->bufpos < tmpinfo->bufmax) {
-	/* rewind the FD to pretend we're not buffering */
-	off_t diff = tmpinfo->bufmax - tmpinfo->bufpos;
-	if (lseek(tmpinfo->fd, -diff, SEEK_CUR) == (off_t) -1) {
+    /* rewind the FD to pretend we're not buffering */
+    unread_input(tmpinfo, true);
+
+    info->state = tmpinfo->state;
+    free(tmpinfo);
+    return result;
+}
+
+/* Hands back the bytes that have been read ahead into `info->buf' but not yet
+ * used. If `info->fd' is seekable, the file offset is rewound so that the bytes
+ * are read again by whoever reads the file next. The bytes cannot be handed
+ * back to a non-seekable file such as a pipe; they remain in the buffer unless
+ * `discard' is true. */
+void unread_input(struct input_file_info_T *info, bool discard)
+{
+    if (info->bufpos >= info->bufmax)
+	return;
+
+    if (is_seekable_file(info->fd)) {
+	off_t diff = info->bufmax - info->bufpos;
+	if (lseek(info->fd, -diff, SEEK_CUR) == (off_t) -1) {
 	    xerror(errno,
 		    Ngt("cannot rewind file descriptor %d after reading. "
 			"Subsequent reads may lack some text"),
-		    tmpinfo->fd);
+		    info->fd);
 	}
+    } else if (!discard) {
+	return;
     }
-
-    info->state = tmpinfo->state;
-    free(tmpinfo);
-    return result;
+    info->bufpos = info->bufmax = 0;
 }
 
 /* An input function that prints a prompt and reads input.
@@ -244,6 +295,7 @@ inputresult_T input_interactive(struct xwcsbuf_T *buf, void *inputinfo)
 	if (!posixly_correct)
 	    exec_variable_as_auxiliary_(VAR_PROMPT_COMMAND);
 	check_mail();
+	revalidate_dirindexes();
     }
     prompt = get_prompt(info->prompttype);
     if (do_job_control)
@@ -253,6 +305,8 @@ inputresult_T input_interactive(struct xwcsbuf_T *buf, void *inputinfo)
      * `handle_sigchld' must not be called from any other function until it is
      * called from `wait_for_input' during the line-editing. */
 
+    flush_stdout();
+
 #if YASH_ENABLE_LINEEDIT
     /* read a line using line editing */
     if (info->fileinfo->fd == STDIN_FILENO
@@ -433,6 +487,8 @@ wchar_t *expand_ps1_posix(wchar_t *s)
  * These are ignored in this function. */
 void print_prompt(const wchar_t *s)
 {
+    flush_stdout();
+
 #if YASH_ENABLE_LINEEDIT
     if (le_try_print_prompt(s))
 	return;
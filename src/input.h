@@ -58,6 +58,11 @@ struct input_file_info_T;
 extern inputresult_T read_input(
 	struct xwcsbuf_T *buf, struct input_file_info_T *info, _Bool trap)
     __attribute__((nonnull));
+extern inputresult_T fill_input_buffer(
+	struct input_file_info_T *info, _Bool trap)
+    __attribute__((nonnull));
+extern void unread_input(struct input_file_info_T *info, _Bool discard)
+    __attribute__((nonnull));
 
 /* The type of input functions.
  * An input function reads input and appends it to buffer `buf'.
@@ -91,9 +96,15 @@ struct input_file_info_T {
     int fd;
     mbstate_t state;
     size_t bufpos, bufmax, bufsize;
+    _Bool readahead;
     char buf[];
 };
-/* `bufsize' is the size of `buf', which must be at least one byte. */
+/* `bufsize' is the size of `buf', which must be at least one byte.
+ * If `readahead' is true, up to `bufsize' bytes are read from `fd' at a time.
+ * Otherwise, no bytes beyond the end of the line are consumed from `fd' so that
+ * other processes can read the rest of the input: one byte is read at a time
+ * unless `fd' is seekable. Bytes that remain in `buf' (between `bufpos' and
+ * `bufmax') are always used before reading `fd' again. */
 
 /* to be used as `inputinfo' for `input_interactive' */
 struct input_interactive_info_T {
@@ -25,6 +25,7 @@
 #endif
 #include <signal.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -35,7 +36,9 @@
 #include <wctype.h>
 #include "builtin.h"
 #include "exec.h"
+#include "hashtable.h"
 #include "option.h"
+#include "path.h"
 #include "plist.h"
 #include "redir.h"
 #include "sig.h"
@@ -54,7 +57,16 @@
 static inline job_T *get_job(size_t jobnumber)
     __attribute__((pure));
 static inline void free_job(job_T *job);
+static void discard_job(size_t jobnumber);
 static void trim_joblist(void);
+static hashval_T hashpid(const void *pidp)
+    __attribute__((nonnull,pure));
+static int pidcmp(const void *pidp1, const void *pidp2)
+    __attribute__((nonnull,pure));
+static void index_job_processes(size_t jobnumber);
+static void unindex_job_processes(job_T *job)
+    __attribute__((nonnull));
+static void reindex_pid(pid_t pid);
 static void set_current_jobnumber(size_t jobnumber);
 static size_t find_next_job(size_t numlimit);
 static void apply_curstop(void);
@@ -95,12 +107,28 @@ static plist_T joblist;
 /* number of the current/previous jobs. 0 if none. */
 static size_t current_jobnumber, previous_jobnumber;
 
+/* No job number less than this (except ACTIVE_JOBNO) is unused in the job list.
+ */
+static size_t first_free_jobnumber = 1;
+
+/* The index of the processes in the job list.
+ * A key is a pointer to the `pr_pid' member of a process in the job list and
+ * the value is the number of the job containing the process, cast to a
+ * pointer. Processes whose `pr_pid' is zero are not indexed.
+ * When a process ID is reused while the job containing the old process is still
+ * in the job list, the newer process is indexed in place of the older one. In
+ * that case `pid_reused' is set and the older process is indexed again when the
+ * newer one is removed. */
+static hashtable_T pidindex;
+static bool pid_reused = false;
+
 /* Initializes the job list. */
 void init_job(void)
 {
     assert(joblist.contents == NULL);
     pl_init(&joblist);
     pl_add(&joblist, NULL);
+    ht_init(&pidindex, hashpid, pidcmp);
 }
 
 /* Sets the active job. */
@@ -109,6 +137,7 @@ void set_active_job(job_T *job)
     assert(ACTIVE_JOBNO < joblist.length);
     assert(joblist.contents[ACTIVE_JOBNO] == NULL);
     joblist.contents[ACTIVE_JOBNO] = job;
+    index_job_processes(ACTIVE_JOBNO);
 }
 
 /* Moves the active job into the job list.
@@ -124,7 +153,8 @@ void add_job(bool current)
     joblist.contents[ACTIVE_JOBNO] = NULL;
 
     /* if there is an empty element in the list, use it */
-    for (jobnumber = 1; jobnumber < joblist.length; jobnumber++) {
+    for (jobnumber = first_free_jobnumber; jobnumber < joblist.length;
+	    jobnumber++) {
 	if (joblist.contents[jobnumber] == NULL) {
 	    joblist.contents[jobnumber] = job;
 	    goto set_current;
@@ -132,10 +162,13 @@ void add_job(bool current)
     }
 
     /* if there is no empty, append at the end of the list */
+    jobnumber = joblist.length;
     pl_add(&joblist, job);
 
 set_current:
     assert(joblist.contents[jobnumber] == job);
+    first_free_jobnumber = jobnumber + 1;
+    index_job_processes(jobnumber);
     if (job->j_status == JS_STOPPED || current)
 	set_current_jobnumber(jobnumber);
     else
@@ -153,8 +186,7 @@ job_T *get_job(size_t jobnumber)
  * (another job is assigned to it). */
 void remove_job(size_t jobnumber)
 {
-    free_job(get_job(jobnumber));
-    joblist.contents[jobnumber] = NULL;
+    discard_job(jobnumber);
     trim_joblist();
     set_current_jobnumber(current_jobnumber);
 }
@@ -166,6 +198,9 @@ void remove_all_jobs(void)
 	free_job(joblist.contents[i]);
 	joblist.contents[i] = NULL;
     }
+    ht_clear(&pidindex, NULL);
+    pid_reused = false;
+    first_free_jobnumber = 1;
     trim_joblist();
     current_jobnumber = previous_jobnumber = 0;
 }
@@ -180,6 +215,22 @@ void free_job(job_T *job)
     }
 }
 
+/* Removes the job of the specified number from the job list and the process
+ * index, and frees it. Unlike `remove_job', the current/previous jobs are not
+ * updated and the job list is not trimmed. */
+void discard_job(size_t jobnumber)
+{
+    job_T *job = get_job(jobnumber);
+    if (job == NULL)
+	return;
+
+    joblist.contents[jobnumber] = NULL;
+    unindex_job_processes(job);
+    free_job(job);
+    if (jobnumber != ACTIVE_JOBNO && jobnumber < first_free_jobnumber)
+	first_free_jobnumber = jobnumber;
+}
+
 /* Shrink the job list, removing unused elements. */
 void trim_joblist(void)
 {
@@ -195,6 +246,83 @@ void trim_joblist(void)
     }
 }
 
+/* Hash function for `pidindex'. */
+hashval_T hashpid(const void *pidp)
+{
+    return (hashval_T) *(const pid_t *) pidp * FNVPRIME;
+}
+
+/* Comparison function for `pidindex'. */
+int pidcmp(const void *pidp1, const void *pidp2)
+{
+    return *(const pid_t *) pidp1 != *(const pid_t *) pidp2;
+}
+
+/* Adds the processes of the specified job to `pidindex'.
+ * If the job was already indexed under a different job number, the entries are
+ * updated. */
+void index_job_processes(size_t jobnumber)
+{
+    job_T *job = joblist.contents[jobnumber];
+    for (size_t i = 0; i < job->j_pcount; i++) {
+	process_T *pr = &job->j_procs[i];
+	if (pr->pr_pid == 0)
+	    continue;
+
+	kvpair_T old = ht_set(&pidindex,
+		&pr->pr_pid, (void *) (uintptr_t) jobnumber);
+	if (old.key != NULL && old.key != &pr->pr_pid)
+	    pid_reused = true;
+    }
+}
+
+/* Removes the processes of the specified job from `pidindex'.
+ * The job must have been removed from the job list. */
+void unindex_job_processes(job_T *job)
+{
+    for (size_t i = 0; i < job->j_pcount; i++) {
+	process_T *pr = &job->j_procs[i];
+	if (pr->pr_pid == 0)
+	    continue;
+
+	/* remove the entry only if it is of this process */
+	if (ht_get(&pidindex, &pr->pr_pid).key == &pr->pr_pid) {
+	    ht_remove(&pidindex, &pr->pr_pid);
+	    if (pid_reused)
+		reindex_pid(pr->pr_pid);
+	}
+    }
+}
+
+/* Searches the job list for another process having the specified process ID
+ * and, if found, adds it to `pidindex'. A running process is preferred;
+ * otherwise, the process in the job of the largest number is chosen.
+ * This function is called only after a process ID has been reused. */
+void reindex_pid(pid_t pid)
+{
+    process_T *found = NULL;
+    size_t foundjobnumber = 0;
+
+    for (size_t jobnumber = joblist.length; jobnumber-- > 0; ) {
+	job_T *job = joblist.contents[jobnumber];
+	if (job == NULL)
+	    continue;
+	for (size_t i = 0; i < job->j_pcount; i++) {
+	    process_T *pr = &job->j_procs[i];
+	    if (pr->pr_pid != pid || &pr->pr_pid == ht_get(&pidindex,
+			&pr->pr_pid).key)
+		continue;
+	    if (found == NULL || (found->pr_status == JS_DONE
+			&& pr->pr_status != JS_DONE)) {
+		found = pr;
+		foundjobnumber = jobnumber;
+	    }
+	}
+    }
+    if (found != NULL)
+	ht_set(&pidindex, &found->pr_pid, (void *) (uintptr_t) foundjobnumber);
+}
+
 /* Sets the `j_legacy' flags of all jobs.
  * All the jobs will be no longer job-controlled. */
 void neglect_all_jobs(void)
@@ -386,26 +514,27 @@ start:
 	return;
     }
 
-    size_t jobnumber, pnumber;
-    job_T *job;
-    process_T *pr;
-
-    /* determine `jobnumber', `job' and `pr' from `pid' */
-    for (jobnumber = 0; jobnumber < joblist.length; jobnumber++)
-	if ((job = joblist.contents[jobnumber]) != NULL)
-	    for (pnumber = 0; pnumber < job->j_pcount; pnumber++)
-		if ((pr = &job->j_procs[pnumber])->pr_pid == pid &&
-			pr->pr_status != JS_DONE)
-		    goto found;
-
-    /* If `pid' was not found in the job list, we simply ignore it. This may
-     * happen on some occasions: e.g. the job has been "disown"ed. */
-    goto start;
+    /* determine `job' and `pr' from `pid' */
+    kvpair_T kv = ht_get(&pidindex, &pid);
+    if (kv.key == NULL)
+	/* If `pid' was not found in the job list, we simply ignore it. This
+	 * may happen on some occasions: e.g. the job has been "disown"ed. */
+	goto start;
+
+    job_T *job = joblist.contents[(uintptr_t) kv.value];
+    process_T *pr = (process_T *) ((char *) kv.key
+	    - offsetof(process_T, pr_pid));
+    assert(job != NULL);
+    assert(&job->j_procs[0] <= pr && pr < &job->j_procs[job->j_pcount]);
+    if (pr->pr_status == JS_DONE)
+	goto start;
 
-found:
     pr->pr_statuscode = status;
-    if (WIFEXITED(status) || WIFSIGNALED(status))
+    if (WIFEXITED(status) || WIFSIGNALED(status)) {
 	pr->pr_status = JS_DONE;
+	/* The process may have modified directories in $PATH. */
+	revalidate_dirindexes();
+    }
     if (WIFSTOPPED(status))
 	pr->pr_status = JS_STOPPED;
 #ifdef HAVE_WCONTINUED
@@ -765,6 +894,8 @@ int print_job_status(size_t jobnumber,
     if (changedonly && !job->j_statuschanged)
 	return result;
 
+    flush_stdout();
+
     char current;
     if      (jobnumber == current_jobnumber)  current = '+';
     else if (jobnumber == previous_jobnumber) current = '-';
@@ -926,19 +1057,12 @@ size_t get_jobnumber_from_name(const wchar_t *name)
  * If not found, 0 is returned. */
 size_t get_jobnumber_from_pid(long pid)
 {
-    size_t jobnumber;
-    if (pid == 0)
+    pid_t p = (pid_t) pid;
+    if (p <= 0 || p != pid)
 	return 0;
-    for (jobnumber = joblist.length; --jobnumber > 0; ) {
-	job_T *job = joblist.contents[jobnumber];
-	if (job != NULL) {
-	    for (size_t i = 0; i < job->j_pcount; i++)
-		if (job->j_procs[i].pr_pid == pid)
-		    goto found;
-	}
-    }
-found:
-    return jobnumber;
+
+    kvpair_T kv = ht_get(&pidindex, &p);
+    return (kv.key != NULL) ? (size_t) (uintptr_t) kv.value : 0;
 }
 
 #if YASH_ENABLE_LINEEDIT
@@ -1090,6 +1214,7 @@ bool jobs_builtin_print_job(size_t jobnumber,
     if (pgidonly) {
 	if (changedonly && !job->j_statuschanged)
 	    return true;
+	flush_stdout();
 	int result = printf("%jd\n", (intmax_t) job->j_pgid);
 	err = (result >= 0) ? 0 : errno;
     } else {
@@ -1291,6 +1416,9 @@ int wait_builtin(int argc, void **argv)
 	}
     }
 
+    /* Jobs may be waiting for the output of preceding built-ins. */
+    flush_stdout();
+
     if (xoptind < argc) {
 	/* wait for the specified jobs */
 	for (; xoptind < argc; xoptind++) {
@@ -1365,12 +1493,21 @@ int wait_for_job_by_jobspec(const wchar_t *jobspec)
 bool wait_builtin_has_job(bool jobcontrol)
 {
     /* print/remove already-finished jobs */
+    bool removed = false;
     for (size_t i = 1; i < joblist.length; i++) {
 	job_T *job = joblist.contents[i];
 	if (jobcontrol && is_interactive_now && !posixly_correct)
 	    print_job_status(i, true, false, false, stdout);
-	if (job != NULL && (job->j_legacy || job->j_status == JS_DONE))
-	    remove_job(i);
+	if (job != NULL && (job->j_legacy || job->j_status == JS_DONE)) {
+	    /* The job list is trimmed and the current job is updated once
+	     * after the loop rather than for each job removed. */
+	    discard_job(i);
+	    removed = true;
+	}
+    }
+    if (removed) {
+	trim_joblist();
+	set_current_jobnumber(current_jobnumber);
     }
 
     /* see if we have jobs to wait for. */
@@ -112,8 +112,10 @@ static void free_candidate(void *c)
     __attribute__((nonnull));
 static void free_context(le_context_T *ctxt);
 static void sort_candidates(void);
-static int sort_candidates_cmp(const void *cp1, const void *cp2)
-    __attribute__((nonnull));
+static const wchar_t *sort_candidates_str(const void *cp)
+    __attribute__((nonnull,pure));
+static int sort_candidates_precmp(const void *cp1, const void *cp2)
+    __attribute__((nonnull,pure));
 static void print_context_info(const le_context_T *ctxt)
     __attribute__((nonnull));
 static void print_compopt_info(const le_compopt_T *compopt)
@@ -417,9 +419,9 @@ void free_context(le_context_T *ctxt)
 /* Sorts the candidates in the candidate list and removes duplicates. */
 void sort_candidates(void)
 {
-    qsort(le_candidates.contents,
+    sort_by_collation(le_candidates.contents,
 	    le_candidates.length, sizeof *le_candidates.contents,
-	    sort_candidates_cmp);
+	    sort_candidates_str, sort_candidates_precmp);
 
     if (le_candidates.length >= 2) {
 	for (size_t i = le_candidates.length - 1; i > 0; i--) {
@@ -434,7 +436,20 @@ void sort_candidates(void)
     }
 }
 
-int sort_candidates_cmp(const void *cp1, const void *cp2)
+/* Returns the string by which the candidate is sorted in collation order.
+ * Leading hyphens are skipped because they are compared in
+ * `sort_candidates_precmp'. */
+const wchar_t *sort_candidates_str(const void *cp)
+{
+    const wchar_t *v = (*(const le_candidate_T **) cp)->origvalue;
+    while (*v == L'-')
+	v++;
+    return v;
+}
+
+/* Compares two candidates before they are compared in collation order.
+ * Returns zero if the order is determined by `sort_candidates_str'. */
+int sort_candidates_precmp(const void *cp1, const void *cp2)
 {
     const le_candidate_T *cand1 = *(const le_candidate_T **) cp1;
     const le_candidate_T *cand2 = *(const le_candidate_T **) cp2;
@@ -452,13 +467,11 @@ int sort_candidates_cmp(const void *cp1, const void *cp2)
 	if (*v2 == L'-')
 	    return -1;
 #if HAVE_WCSCASECMP
-	int cmp = wcscasecmp(v1, v2);
-	if (cmp != 0)
-	    return cmp;
+	return wcscasecmp(v1, v2);
 #endif
     }
 
-    return wcscoll(v1, v2);
+    return 0;
     // XXX case-sensitive
 }
 
@@ -947,27 +960,32 @@ void generate_external_command_candidates(const le_compopt_T *compopt)
 	return;
     sb_init(&path);
     for (const char *dirpath; (dirpath = *paths) != NULL; paths++) {
-	DIR *dir = opendir(dirpath);
-	struct dirent *de;
+	/* The directory index remembers which files were executable when the
+	 * directory was read, so only the other files need to be examined. */
+	char *const *executables, *const *others;
 	size_t dirpathlen;
 
-	if (dir == NULL)
+	if (!get_dir_command_names(dirpath, &executables, &others))
 	    continue;
+	for (const char *name; (name = *executables) != NULL; executables++)
+	    if (le_match_comppatterns(compopt, name))
+		le_new_candidate(CT_COMMAND,
+			malloc_mbstowcs(name), NULL, compopt);
+
 	sb_cat(&path, dirpath);
 	if (path.length > 0 && path.contents[path.length - 1] != '/')
 	    sb_ccat(&path, '/');
 	dirpathlen = path.length;
-	while ((de = readdir(dir)) != NULL) {
-	    if (!le_match_comppatterns(compopt, de->d_name))
+	for (const char *name; (name = *others) != NULL; others++) {
+	    if (!le_match_comppatterns(compopt, name))
 		continue;
-	    sb_cat(&path, de->d_name);
+	    sb_cat(&path, name);
 	    if (is_executable_regular(path.contents))
 		le_new_candidate(CT_COMMAND,
-			malloc_mbstowcs(de->d_name), NULL, compopt);
+			malloc_mbstowcs(name), NULL, compopt);
 	    sb_truncate(&path, dirpathlen);
 	}
 	sb_clear(&path);
-	closedir(dir);
     }
     sb_destroy(&path);
 }
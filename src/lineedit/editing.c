@@ -37,6 +37,7 @@
 #include "../alias.h"
 #include "../exec.h"
 #include "../expand.h"
+#include "../hashtable.h"
 #include "../history.h"
 #include "../job.h"
 #include "../option.h"
@@ -174,16 +175,22 @@ static plist_T undo_history;
 /* Index of the current state in the history.
  * If the current state is the newest, the index is `undo_history.length'. */
 static size_t undo_index;
+/* The contents of the edit line in the state at `undo_index'. */
+static xwcsbuf_T undo_buffer;
 /* The history entry that is saved in the undo history. */
 static const histlink_T *undo_history_entry;
 /* The index that is to be the value of the `index' member of the next undo
  * history entry. */
 static size_t undo_save_index;
-/* Structure of history entries */
+/* Structure of history entries.
+ * Each entry represents a state of the edit line, but only the difference from
+ * the previous state is saved: the `oldlength' characters at `position' in the
+ * previous state are replaced with the `newlength' characters. The first entry
+ * has no difference. */
 struct undo_history {
     size_t index;        /* index of the cursor */
-    wchar_t contents[];  /* contents of the edit line */
-    // `contents' is a copy of `le_main_buffer.contents' up to `le_main_length'.
+    size_t position, oldlength, newlength;
+    wchar_t text[];      /* the old characters followed by the new ones */
 };
 
 #define KILL_RING_SIZE 32  /* must be power of 2 */
@@ -202,8 +209,30 @@ static bool reset_completion;
 /* The next value of `reset_completion'. */
 static bool next_reset_completion;
 
-/* Probability distribution tree for command prediction. */
+/* Probability distribution tree for command prediction.
+ * The probability of each command consists of two terms: the number of history
+ * entries having the command, which is updated as entries are added to or
+ * removed from the history, and the context term, which depends on the latest
+ * commands and is recomputed for each edit. */
 static trie_T *prediction_tree = NULL;
+/* A distinct command in the history. */
+struct predcmd_T {
+    wchar_t *command;  /* NULL if the entry value could not be converted */
+    plist_T entries;   /* history entries having the command, oldest first */
+    size_t oldest;     /* index of the oldest valid element of `entries' */
+    double context;    /* context term currently added to `prediction_tree' */
+};
+/* A hashtable that maps the values of history entries (multibyte strings) to
+ * pointers to `predcmd_T' structures for the commands in `prediction_tree'.
+ * Valid only while `prediction_tree' is non-NULL. */
+static hashtable_T prediction_commands;
+/* True if `prediction_commands' contains all the entries in the history.
+ * While this is false, entries added to or removed from the history are not
+ * counted and the whole history is counted again in the next edit. */
+static bool prediction_counted;
+/* List of pointers to the `predcmd_T' structures whose `context' is
+ * non-zero. */
+static plist_T prediction_context;
 
 
 static void reset_state(void);
@@ -214,8 +243,14 @@ static size_t active_length(void)
     __attribute__((pure));
 static void save_current_edit_command(void);
 static void save_current_find_command(void);
+static void reset_undo_history(
+	const wchar_t *contents, size_t length, size_t index)
+    __attribute__((nonnull));
 static void save_undo_history(void);
 static void maybe_save_undo_history(void);
+static void replace_undo_range(size_t position, size_t oldlength,
+	const wchar_t *text, size_t newlength)
+    __attribute__((nonnull));
 static void exec_motion_command(size_t new_index, bool inclusive);
 static void set_motion_expect_command(enum motion_expect_command_T cmd);
 static void exec_motion_expect_command(
@@ -295,7 +330,10 @@ static void cancel_undo(int offset);
 
 static void check_reset_completion(void);
 
-static void create_prediction_tree(void);
+static void update_prediction_tree(void);
+static void clear_prediction_context(void);
+static void free_prediction_tree(void);
+static void free_predcmd(kvpair_T kv);
 static size_t count_matching_previous_commands(const histentry_T *e1)
     __attribute__((nonnull,pure));
 static void clear_prediction(void);
@@ -326,6 +364,8 @@ static void update_search(void);
 static void perform_search(const wchar_t *pattern,
 	enum le_search_direction_T dir, enum le_search_type_T type)
     __attribute__((nonnull));
+static char *get_search_literal(const wchar_t *pattern, bool literal)
+    __attribute__((nonnull,malloc,warn_unused_result));
 static void search_again(enum le_search_direction_T dir);
 static void beginning_search(enum le_search_direction_T dir);
 static inline bool beginning_search_check_go_to_history(const wchar_t *prefix)
@@ -356,10 +396,9 @@ void le_editing_init(void)
 
     start_using_history();
     pl_init(&undo_history);
-    undo_index = 0;
+    wb_init(&undo_buffer);
     undo_save_index = le_main_index;
-    undo_history_entry = Histlist;
-    save_undo_history();
+    reset_undo_history(le_main_buffer.contents, active_length(), le_main_index);
 
     reset_completion = true;
 
@@ -367,8 +406,10 @@ void le_editing_init(void)
     set_overwriting(false);
 
     if (shopt_le_predict) {
-	create_prediction_tree();
+	update_prediction_tree();
 	update_buffer_with_prediction();
+    } else {
+	free_prediction_tree();
     }
 }
 
@@ -379,6 +420,7 @@ wchar_t *le_editing_finalize(void)
     assert(le_search_buffer.contents == NULL);
 
     plfree(pl_toary(&undo_history), free);
+    wb_destroy(&undo_buffer);
 
     le_complete_cleanup();
 
@@ -386,7 +428,6 @@ wchar_t *le_editing_finalize(void)
     free(main_history_value);
 
     clear_prediction();
-    trie_destroy(prediction_tree), prediction_tree = NULL;
     wb_wccat(&le_main_buffer, L'\n');
     return wb_towcs(&le_main_buffer);
 }
@@ -493,26 +534,57 @@ void save_current_find_command(void)
 	last_find_command = current_command;
 }
 
+/* Clears the undo history and saves the first `length' characters of
+ * `contents' as the only state, with the cursor at `index'. */
+void reset_undo_history(const wchar_t *contents, size_t length, size_t index)
+{
+    pl_clear(&undo_history, free);
+    wb_ncat_force(wb_clear(&undo_buffer), contents, length);
+
+    struct undo_history *e = xmalloc(sizeof *e);
+    e->index = index;
+    e->position = e->oldlength = e->newlength = 0;
+    pl_add(&undo_history, e);
+    undo_index = 0;
+    undo_history_entry = main_history_entry;
+}
+
 /* Saves the current contents of the edit line to the undo history.
  * History entries at the current `undo_index' and newer are removed before
- * saving the current. If `undo_history_entry' is different from
- * `main_history_entry', all undo history entries are removed. */
+ * saving the current. `undo_buffer' must contain the contents of the state
+ * that precedes `undo_index'; it is updated to the current contents. */
 void save_undo_history(void)
 {
+    assert(undo_index > 0);
     for (size_t i = undo_index; i < undo_history.length; i++)
 	free(undo_history.contents[i]);
     pl_remove(&undo_history, undo_index, SIZE_MAX);
 
-    // No need to check for overflow in `len + 1' here. Should overflow occur,
-    // the buffer would not have been allocated successfully.
-    size_t len = active_length();
-    struct undo_history *e = xmallocs(sizeof *e, len + 1, sizeof *e->contents);
+    /* Only the range between the common prefix and suffix is saved. */
+    const wchar_t *old = undo_buffer.contents, *new = le_main_buffer.contents;
+    size_t oldlen = undo_buffer.length, newlen = active_length();
+    size_t prefix = 0, suffix = 0;
+    while (prefix < oldlen && prefix < newlen && old[prefix] == new[prefix])
+	prefix++;
+    while (suffix < oldlen - prefix && suffix < newlen - prefix
+	    && old[oldlen - suffix - 1] == new[newlen - suffix - 1])
+	suffix++;
+    oldlen -= prefix + suffix;
+    newlen -= prefix + suffix;
+
+    struct undo_history *e = xmallocs(sizeof *e,
+	    add(oldlen, newlen), sizeof *e->text);
     e->index = le_main_index;
-    wcsncpy(e->contents, le_main_buffer.contents, len);
-    e->contents[len] = L'\0';
+    e->position = prefix;
+    e->oldlength = oldlen;
+    e->newlength = newlen;
+    wmemcpy(e->text, &old[prefix], oldlen);
+    wmemcpy(&e->text[oldlen], &new[prefix], newlen);
     pl_add(&undo_history, e);
     assert(undo_index == undo_history.length - 1);
     undo_history_entry = main_history_entry;
+
+    wb_replace_force(&undo_buffer, prefix, oldlen, &new[prefix], newlen);
 }
 
 /* Calls `save_undo_history' if the current contents of the edit line is not
@@ -527,11 +599,11 @@ void maybe_save_undo_history(void)
     size_t len = active_length();
     if (undo_history_entry == main_history_entry) {
 	if (undo_index < undo_history.length) {
-	    struct undo_history *h = undo_history.contents[undo_index];
-	    if (wcsncmp(le_main_buffer.contents, h->contents, len) == 0 &&
-		    h->contents[len] == L'\0') {
+	    if (len == undo_buffer.length && wmemcmp(le_main_buffer.contents,
+			undo_buffer.contents, len) == 0) {
 		/* The contents of the main buffer is the same as saved in the
 		 * history. Just save the index. */
+		struct undo_history *h = undo_history.contents[undo_index];
 		h->index = le_main_index;
 		return;
 	    }
@@ -546,19 +618,23 @@ void maybe_save_undo_history(void)
 	 * history entry, but it's not yet saved in the undo history. We first
 	 * save the original history value and then save the current buffer
 	 * contents. */
-	struct undo_history *h;
-	pl_clear(&undo_history, free);
-	h = xmallocs(sizeof *h,
-		add(wcslen(main_history_value), 1), sizeof *h->contents);
-	assert(save_undo_save_index <= wcslen(main_history_value));
-	h->index = save_undo_save_index;
-	wcscpy(h->contents, main_history_value);
-	pl_add(&undo_history, h);
+	size_t histlen = wcslen(main_history_value);
+	assert(save_undo_save_index <= histlen);
+	reset_undo_history(main_history_value, histlen, save_undo_save_index);
 	undo_index = 1;
     }
     save_undo_history();
 }
 
+/* Replaces the `oldlength' characters at `position' in both `undo_buffer' and
+ * `le_main_buffer' with the `newlength' characters of `text'. */
+void replace_undo_range(size_t position, size_t oldlength,
+	const wchar_t *text, size_t newlength)
+{
+    wb_replace_force(&undo_buffer, position, oldlength, text, newlength);
+    wb_replace_force(&le_main_buffer, position, oldlength, text, newlength);
+}
+
 /* Applies the currently pending editing command to the range between the
  * current cursor index and the specified index. If no editing command is
  * pending, simply moves the cursor to the specified index. */
@@ -2236,6 +2312,8 @@ void cancel_undo(int offset)
 
     if (undo_history_entry != main_history_entry)
 	goto error;
+
+    size_t old_undo_index = undo_index;
     if (offset < 0) {
 	if (undo_index == 0)
 	    goto error;
@@ -2260,8 +2338,20 @@ void cancel_undo(int offset)
 	    undo_index += offset;
     }
 
+    /* The main buffer has the same contents as `undo_buffer' here. Revert or
+     * replay the differences to reach the state at the new index. */
+    assert(le_main_buffer.length == undo_buffer.length);
+    for (size_t i = old_undo_index; i > undo_index; i--) {
+	const struct undo_history *e = undo_history.contents[i];
+	replace_undo_range(e->position, e->newlength, e->text, e->oldlength);
+    }
+    for (size_t i = old_undo_index + 1; i <= undo_index; i++) {
+	const struct undo_history *e = undo_history.contents[i];
+	replace_undo_range(e->position, e->oldlength,
+		&e->text[e->oldlength], e->newlength);
+    }
+
     const struct undo_history *entry = undo_history.contents[undo_index];
-    wb_replace(&le_main_buffer, 0, SIZE_MAX, entry->contents, SIZE_MAX);
     assert(entry->index <= le_main_buffer.length);
     le_main_index = entry->index;
 
@@ -2495,30 +2585,68 @@ void check_reset_completion(void)
 #define MAX_PREDICTION_SAMPLE 10000
 #endif /* ifndef MAX_PREDICTION_SAMPLE */
 
-/* Create a probability distribution tree for command prediction based on the
- * current history. The result is set to `prediction_tree'. */
-void create_prediction_tree(void)
-{
-    trie_T *t = trie_create();
+/* Updates the probability distribution tree for command prediction
+ * (`prediction_tree') based on the current history.
+ * The number of entries for each command is maintained by
+ * `le_prediction_add_entry' and `le_prediction_remove_entry', so this function
+ * counts the whole history only if the tree has not been built yet or the
+ * history has been cleared or re-read. The context term is recomputed from the
+ * entries that followed earlier occurrences of the latest command. */
+void update_prediction_tree(void)
+{
+    if (prediction_tree == NULL) {
+	prediction_tree = trie_create();
+	ht_init(&prediction_commands, hashstr, htstrcmp);
+	pl_init(&prediction_context);
+	prediction_counted = false;
+    }
+    if (!prediction_counted) {
+	prediction_counted = true;
+	for (const histlink_T *l = Histlist; (l = l->next) != Histlist; )
+	    le_prediction_add_entry(ashistentry(l));
+    }
+
+    clear_prediction_context();
+    if (histlist.count == 0)
+	return;
+
+    const histentry_T *newest = ashistentry(histlist.Newest);
+    const struct predcmd_T *latest =
+	ht_get(&prediction_commands, newest->value).value;
+    assert(latest != NULL);
+
 #define N 4
     size_t hits[N] = {0};
-    for (const histlink_T *l = Histlist; (l = l->prev) != Histlist; ) {
-	const histentry_T *e = (const histentry_T *) l;
-	size_t k = count_matching_previous_commands(e);
+    for (size_t i = latest->entries.length; i-- > latest->oldest; ) {
+	const histentry_T *e = latest->entries.contents[i];
+	if (e->Next == Histlist)
+	    continue;
+
+	const histentry_T *follower = ashistentry(e->Next);
+	size_t k = count_matching_previous_commands(follower);
 	assert(k < N);
-	for (size_t i = 0; i <= k; i++)
-	    hits[i]++;
+	for (size_t j = 0; j <= k; j++)
+	    hits[j]++;
 	if (hits[0] >= MAX_PREDICTION_SAMPLE)
 	    break;
 
-	wchar_t *cmd = malloc_mbstowcs(e->value);
-	if (cmd == NULL)
-	    continue;
-	t = trie_add_probability(t, cmd, 1.0 / (hits[k] + 1));
-	free(cmd);
+	struct predcmd_T *c =
+	    ht_get(&prediction_commands, follower->value).value;
+	assert(c != NULL);
+	if (c->context == 0.0)
+	    pl_add(&prediction_context, c);
+	c->context += 1.0 / (hits[k] + 1);
     }
 
-    prediction_tree = t;
+    /* The context term is scaled by the number of entries so that it is
+     * comparable with the number of entries for each command. */
+    for (size_t i = 0; i < prediction_context.length; i++) {
+	struct predcmd_T *c = prediction_context.contents[i];
+	c->context *= histlist.count;
+	if (c->command != NULL)
+	    prediction_tree = trie_add_probability(
+		    prediction_tree, c->command, c->context);
+    }
 }
 
 // Counts N-1 at most
@@ -2541,6 +2669,123 @@ size_t count_matching_previous_commands(const histentry_T *e)
 }
 #undef N
 
+/* Subtracts the context term of each command from `prediction_tree'. */
+void clear_prediction_context(void)
+{
+    for (size_t i = 0; i < prediction_context.length; i++) {
+	struct predcmd_T *c = prediction_context.contents[i];
+	if (c->command != NULL)
+	    prediction_tree = trie_add_probability(
+		    prediction_tree, c->command, -c->context);
+	c->context = 0.0;
+    }
+    pl_clear(&prediction_context, 0);
+}
+
+/* Counts the specified history entry, which must have just been added to the
+ * history, in the probability of command prediction.
+ * Does nothing if the prediction tree is not maintained. */
+void le_prediction_add_entry(const struct histentry_T *e)
+{
+    if (prediction_tree == NULL || !prediction_counted)
+	return;
+
+    struct predcmd_T *c = ht_get(&prediction_commands, e->value).value;
+    if (c == NULL) {
+	c = xmalloc(sizeof *c);
+	c->command = malloc_mbstowcs(e->value);
+	pl_init(&c->entries);
+	c->oldest = 0;
+	c->context = 0.0;
+	ht_set(&prediction_commands, xstrdup(e->value), c);
+	if (c->command != NULL)
+	    prediction_tree = trie_add_prediction(prediction_tree, c->command);
+    }
+    pl_add(&c->entries, e);
+    if (c->command != NULL)
+	prediction_tree =
+	    trie_add_probability(prediction_tree, c->command, 1.0);
+}
+
+/* Uncounts the specified history entry, which is about to be removed from the
+ * history, from the probability of command prediction.
+ * Does nothing if the prediction tree is not maintained. */
+void le_prediction_remove_entry(const struct histentry_T *e)
+{
+    if (prediction_tree == NULL || !prediction_counted)
+	return;
+
+    struct predcmd_T *c = ht_get(&prediction_commands, e->value).value;
+    assert(c != NULL);
+    if (c->entries.contents[c->oldest] == e) {
+	c->oldest++;
+    } else {
+	size_t i = c->entries.length;
+	while (c->entries.contents[--i] != e)
+	    assert(i > c->oldest);
+	pl_remove(&c->entries, i, 1);
+    }
+    if (c->oldest > c->entries.length / 2) {
+	pl_remove(&c->entries, 0, c->oldest);
+	c->oldest = 0;
+    }
+
+    if (c->command != NULL)
+	prediction_tree =
+	    trie_add_probability(prediction_tree, c->command, -1.0);
+    if (c->entries.length == 0) {
+	if (c->context != 0.0) {
+	    size_t i = 0;
+	    while (prediction_context.contents[i] != c)
+		i++;
+	    pl_remove(&prediction_context, i, 1);
+	    if (c->command != NULL)
+		prediction_tree = trie_add_probability(
+			prediction_tree, c->command, -c->context);
+	}
+	free_predcmd(ht_remove(&prediction_commands, e->value));
+    }
+}
+
+/* Discards the counts of history entries in the probability of command
+ * prediction. This function must be called when the whole history is cleared
+ * or is about to be re-read. The history is counted again in the next edit. */
+void le_prediction_forget_entries(void)
+{
+    if (prediction_tree == NULL || !prediction_counted)
+	return;
+
+    pl_clear(&prediction_context, 0);
+    ht_clear(&prediction_commands, free_predcmd);
+    trie_clear_probability(prediction_tree);
+    prediction_counted = false;
+}
+
+/* Frees `prediction_tree' and `prediction_commands' if they exist. */
+void free_prediction_tree(void)
+{
+    if (prediction_tree != NULL) {
+	pl_destroy(&prediction_context);
+	ht_clear(&prediction_commands, free_predcmd);
+	ht_destroy(&prediction_commands);
+	trie_destroy(prediction_tree), prediction_tree = NULL;
+    }
+}
+
+/* Frees a key-value pair of `prediction_commands', removing the command from
+ * `prediction_tree'. */
+void free_predcmd(kvpair_T kv)
+{
+    struct predcmd_T *c = kv.value;
+    if (c->command != NULL) {
+	prediction_tree = trie_remove_prediction(prediction_tree, c->command);
+	free(c->command);
+    }
+    pl_destroy(&c->entries);
+    free(c);
+    free(kv.key);
+}
+
 /* Clears the second part of `le_main_buffer'.
  * Commands that modify the buffer usually need to call this function. However,
  * if a command affects or is affected by the second part, the command might
@@ -3491,7 +3736,8 @@ void go_to_history(const histlink_T *l, enum le_search_type_T curpos)
     wb_clear(&le_main_buffer);
     if (l == undo_history_entry && undo_index < undo_history.length) {
 	struct undo_history *h = undo_history.contents[undo_index];
-	wb_cat(&le_main_buffer, h->contents);
+	wb_ncat_force(&le_main_buffer,
+		undo_buffer.contents, undo_buffer.length);
 	assert(h->index <= le_main_buffer.length);
 	le_main_index = h->index;
     } else {
@@ -3691,6 +3937,7 @@ void perform_search(const wchar_t *pattern,
 {
     const histlink_T *l = main_history_entry;
     xfnmatch_T *xfnm;
+    char *literal = NULL;
 
     if (dir == FORWARD && l == Histlist)
 	goto done;
@@ -3700,6 +3947,7 @@ void perform_search(const wchar_t *pattern,
 	    wchar_t *p = escape(pattern, NULL);
 	    xfnm = xfnm_compile(p, XFNM_HEADONLY);
 	    free(p);
+	    literal = get_search_literal(pattern, true);
 	    break;
 	}
 	case SEARCH_VI: {
@@ -3713,24 +3961,31 @@ void perform_search(const wchar_t *pattern,
 		}
 	    }
 	    xfnm = xfnm_compile(pattern, flags);
+	    literal = get_search_literal(pattern, false);
 	    break;
 	}
 	case SEARCH_EMACS: {
 	    wchar_t *p = escape(pattern, NULL);
 	    xfnm = xfnm_compile(p, 0);
 	    free(p);
+	    literal = get_search_literal(pattern, true);
 	    break;
 	}
 	default:
 	    assert(false);
     }
     if (xfnm == NULL) {
+	free(literal);
 	l = Histlist;
 	goto done;
     }
 
+    /* Entries that do not contain the literal part of the pattern are skipped
+     * without being converted into wide strings and matched. */
     for (;;) {
-	switch (dir) {
+	if (literal != NULL)
+	    l = search_history_substring(l, dir == BACKWARD, literal);
+	else switch (dir) {
 	    case FORWARD:   l = l->next;  break;
 	    case BACKWARD:  l = l->prev;  break;
 	}
@@ -3740,10 +3995,61 @@ void perform_search(const wchar_t *pattern,
 	    break;
     }
     xfnm_free(xfnm);
+    free(literal);
 done:
     le_search_result = l;
 }
 
+/* Returns a newly-malloced multibyte string that is contained in every string
+ * that matches `pattern'. If `literal' is true, `pattern' is not a pattern but
+ * a literal string, which is simply converted. Otherwise, the longest part of
+ * `pattern' that contains no special characters is returned.
+ * Returns NULL if there is no such non-empty string or if a multibyte string
+ * containing it might not contain its multibyte representation as a substring
+ * because the encoding is state-dependent. */
+char *get_search_literal(const wchar_t *pattern, bool literal)
+{
+    if (!is_ascii_compatible_encoding())
+	return NULL;
+
+    xwcsbuf_T run, longest;
+    wb_init(&run);
+    wb_init(&longest);
+    for (;;) {
+	wchar_t c = *pattern++;
+	if (!literal) {
+	    switch (c) {
+		case L'\\':
+		    c = *pattern++;
+		    if (c == L'\0')
+			goto end;
+		    break;
+		case L'*':
+		case L'?':
+		    if (run.length > longest.length)
+			wb_ncat_force(wb_clear(&longest), run.contents,
+				run.length);
+		    wb_clear(&run);
+		    continue;
+		case L'[':
+		    goto end;
+	    }
+	}
+	if (c == L'\0')
+	    goto end;
+	wb_wccat(&run, c);
+    }
+end:
+    if (run.length > longest.length)
+	wb_ncat_force(wb_clear(&longest), run.contents, run.length);
+    wb_destroy(&run);
+
+    char *result = (longest.length > 0) ? malloc_wcstombs(longest.contents)
+	                                   : NULL;
+    wb_destroy(&longest);
+    return result;
+}
+
 /* Redoes the last search. */
 void cmd_search_again(wchar_t c __attribute__((unused)))
 {
@@ -3857,8 +4163,7 @@ bool beginning_search_check_go_to_history(const wchar_t *prefix)
 {
     if (le_search_result == undo_history_entry
 	    && undo_index < undo_history.length) {
-	const struct undo_history *h = undo_history.contents[undo_index];
-	return matchwcsprefix(h->contents, prefix) != NULL;
+	return matchwcsprefix(undo_buffer.contents, prefix) != NULL;
     } else {
 	return false;
     }
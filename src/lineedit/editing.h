@@ -43,6 +43,13 @@ extern wchar_t *le_editing_finalize(void)
 extern void le_invoke_command(le_command_func_T *cmd, wchar_t arg)
     __attribute__((nonnull));
 
+struct histentry_T;
+extern void le_prediction_add_entry(const struct histentry_T *e)
+    __attribute__((nonnull));
+extern void le_prediction_remove_entry(const struct histentry_T *e)
+    __attribute__((nonnull));
+extern void le_prediction_forget_entries(void);
+
 
 /********** Commands **********/
 
@@ -410,16 +410,82 @@ void trie_destroy(trienode_T *node)
 
 /********** Functions for prediction **********/
 
+/* Adds key string `keywcs' to the trie without changing the probability of any
+ * node. New nodes are created with zero probability.
+ * Each node counts the keys that pass through it, so that the nodes can be
+ * freed by `trie_remove_prediction' when the last key is removed. */
+trienode_T *trie_add_prediction(trienode_T *node, const wchar_t *keywcs)
+{
+    if (node->valuevalid) {
+	node->value.prediction.keycount++;
+    } else {
+	node->valuevalid = true;
+	node->value.prediction.probability = 0.0;
+	node->value.prediction.keycount = 1;
+    }
+
+    if (keywcs[0] == L'\0')
+	return node;
+
+    ssize_t index = searchw(node, keywcs[0]);
+    if (index < 0) {
+	index = -(index + 1);
+	node = insert_entry(node, (size_t) index,
+		(triekey_T) { .as_wchar = keywcs[0] });
+    }
+    node->entries[index].child = trie_add_prediction(
+	    node->entries[index].child, &keywcs[1]);
+    return node;
+}
+
+/* Removes key string `keywcs', which must have been added by
+ * `trie_add_prediction', from the trie. Nodes that no longer have any keys
+ * passing through them are freed, except the root node. */
+trienode_T *trie_remove_prediction(trienode_T *node, const wchar_t *keywcs)
+{
+    assert(node->valuevalid);
+    assert(node->value.prediction.keycount > 0);
+    node->value.prediction.keycount--;
+
+    if (keywcs[0] == L'\0')
+	return node;
+
+    ssize_t index = searchw(node, keywcs[0]);
+    assert(index >= 0);
+    trienode_T *child = trie_remove_prediction(
+	    node->entries[index].child, &keywcs[1]);
+    if (child->value.prediction.keycount > 0) {
+	node->entries[index].child = child;
+    } else {
+	assert(child->count == 0);
+	free(child);
+	memmove(&node->entries[index], &node->entries[index + 1],
+		sizeof *node->entries * (node->count - index - 1));
+	node = shrink(node);
+    }
+    return node;
+}
+
+/* Resets the probability of all the nodes in the trie to zero. */
+void trie_clear_probability(trienode_T *node)
+{
+    if (node->valuevalid)
+	node->value.prediction.probability = 0.0;
+    for (size_t i = 0; i < node->count; i++)
+	trie_clear_probability(node->entries[i].child);
+}
+
 /* Adds the given probability value `p' to each node on the given key string
  * `keywcs'. */
 trienode_T *trie_add_probability(
 	trienode_T *node, const wchar_t *keywcs, double p)
 {
     if (node->valuevalid) {
-	node->value.probability += p;
+	node->value.prediction.probability += p;
     } else {
 	node->valuevalid = true;
-	node->value.probability = p;
+	node->value.prediction.probability = p;
+	node->value.prediction.keycount = 0;
     }
 
     if (keywcs[0] == L'\0')
@@ -456,7 +522,7 @@ wchar_t *trie_probable_key(const trienode_T *node, const wchar_t *skipkey)
     if (entry == NULL)
 	return xwcsdup(L"");
 
-    double threshold = entry->child->value.probability / 2;
+    double threshold = entry->child->value.prediction.probability / 2;
 
     // Traverse nodes that have the most probability to construct the final
     // result. Stop traversal when the probability falls below the threshold.
@@ -467,7 +533,7 @@ wchar_t *trie_probable_key(const trienode_T *node, const wchar_t *skipkey)
     wb_init(&key);
 
     while (entry != NULL &&
-	    (entry->child->value.probability >= threshold ||
+	    (entry->child->value.prediction.probability >= threshold ||
 	     iswblank(entry->key.as_wchar))) {
 	wb_wccat(&key, entry->key.as_wchar);
 	entry = most_probable_child(entry->child);
@@ -484,7 +550,8 @@ const trieentry_T *most_probable_child(const trienode_T *node)
     const trieentry_T *entry = NULL;
     for (size_t i = 0; i < node->count; i++) {
 	assert(node->entries[i].child->valuevalid);
-	double probability = node->entries[i].child->value.probability;
+	double probability =
+	    node->entries[i].child->value.prediction.probability;
 	if (probability > max_probability) {
 	    max_probability = probability;
 	    entry = &node->entries[i];
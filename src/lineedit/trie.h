@@ -26,7 +26,10 @@
 typedef union trievalue_T {
     const wchar_t *keyseq;
     le_command_func_T *cmdfunc;
-    double probability;
+    struct {
+	double probability;
+	size_t keycount;
+    } prediction;
 } trievalue_T;
 typedef struct trienode_T trie_T;
 typedef struct trieget_T {
@@ -63,6 +66,12 @@ extern int trie_foreachw(const trie_T *t,
     __attribute__((nonnull(1,2)));
 extern void trie_destroy(trie_T *t);
 
+extern trie_T *trie_add_prediction(trie_T *t, const wchar_t *keywcs)
+    __attribute__((nonnull,warn_unused_result));
+extern trie_T *trie_remove_prediction(trie_T *t, const wchar_t *keywcs)
+    __attribute__((nonnull,warn_unused_result));
+extern void trie_clear_probability(trie_T *t)
+    __attribute__((nonnull));
 extern trie_T *trie_add_probability(trie_T *t, const wchar_t *keywcs, double p)
     __attribute__((nonnull,malloc,warn_unused_result));
 extern wchar_t *trie_probable_key(const trie_T *t, const wchar_t *skipkey)
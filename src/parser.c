@@ -38,8 +38,10 @@
 #include "input.h"
 #include "option.h"
 #include "plist.h"
+#include "redir.h"
 #include "strbuf.h"
 #include "util.h"
+#include "xfnmatch.h"
 #if YASH_ENABLE_DOUBLE_BRACKET
 # include "builtins/test.h"
 #endif
@@ -149,6 +151,7 @@ void ifcmdsfree(ifcommand_T *i)
 void caseitemsfree(caseitem_T *i)
 {
     while (i != NULL) {
+	free_case_matchers(i);
 	plfree(i->ci_patterns, wordfree_vp);
 	andorsfree(i->ci_commands);
 
@@ -158,6 +161,17 @@ void caseitemsfree(caseitem_T *i)
     }
 }
 
+/* Frees the cache of compiled patterns in the specified case item. */
+void free_case_matchers(caseitem_T *ci)
+{
+    if (ci->ci_matchers != NULL) {
+	for (size_t i = 0; ci->ci_patterns[i] != NULL; i++)
+	    xfnm_free(ci->ci_matchers[i]);
+	free(ci->ci_matchers);
+	ci->ci_matchers = NULL;
+    }
+}
+
 #if YASH_ENABLE_DOUBLE_BRACKET
 void dbexpfree(dbexp_T *e)
 {
@@ -847,6 +861,7 @@ void serror(parsestate_T *restrict ps, const char *restrict format, ...)
 
     if (ps->info->print_errmsg &&
 	    ps->info->lastinputresult != INPUT_INTERRUPTED) {
+	flush_stdout();
 	if (ps->info->filename != NULL)
 	    fprintf(stderr, "%s:%lu: ", ps->info->filename, ps->info->lineno);
 	fprintf(stderr, gt("syntax error: "));
@@ -939,7 +954,10 @@ inputresult_T read_more_input(parsestate_T *ps)
 #if YASH_ENABLE_LINEEDIT
 	    if (!(le_state & LE_STATE_ACTIVE))
 #endif
+	    {
+		flush_stdout();
 		fprintf(stderr, "%ls", &ps->src.contents[savelength]);
+	    }
     }
     return ps->info->lastinputresult;
 }
@@ -2170,18 +2188,21 @@ assign_T *tryparse_assignment(parsestate_T *ps)
 
     const wchar_t *nameend = skip_name(ps->token->wu_string, is_name_char);
     size_t namelen = nameend - ps->token->wu_string;
-    if (namelen == 0 || *nameend != L'=')
+    bool append = !posixly_correct && nameend[0] == L'+' && nameend[1] == L'=';
+    if (namelen == 0 || (*nameend != L'=' && !append))
 	return NULL;
 
     assign_T *result = xmalloc(sizeof *result);
     result->next = NULL;
+    result->a_append = append;
     result->a_name = xwcsndup(ps->token->wu_string, namelen);
 
-    /* remove the name and '=' from the token */
+    /* remove the name and '=' (or "+=") from the token */
+    const wchar_t *valuestart = &nameend[append ? 2 : 1];
     size_t index_after_first_token = ps->next_index;
     wordunit_T *first_token = ps->token;
     ps->token = NULL;
-    wmemmove(first_token->wu_string, &nameend[1], wcslen(&nameend[1]) + 1);
+    wmemmove(first_token->wu_string, valuestart, wcslen(valuestart) + 1);
     if (first_token->wu_string[0] == L'\0') {
 	wordunit_T *wu = first_token->next;
 	wordunitfree(first_token);
@@ -2668,6 +2689,7 @@ caseitem_T *parse_case_list(parsestate_T *ps)
 	ci->next = NULL;
 	ci->ci_patterns = parse_case_patterns(ps);
 	ci->ci_commands = parse_compound_list(ps);
+	ci->ci_matchers = NULL;
 	/* `ci_commands' may be NULL unlike for and while commands */
 	if (ps->tokentype == TT_DOUBLE_SEMICOLON)
 	    next_token(ps);
@@ -3689,7 +3711,7 @@ void print_assignments(
 {
     while (a != NULL) {
 	wb_cat(&pr->buffer, a->a_name);
-	wb_wccat(&pr->buffer, L'=');
+	wb_cat(&pr->buffer, a->a_append ? L"+=" : L"=");
 	switch (a->a_type) {
 	    case A_SCALAR:
 		print_word(pr, a->a_scalar, indent);
@@ -136,9 +136,16 @@ typedef struct caseitem_T {
     struct caseitem_T *next;
     void             **ci_patterns;  /* patterns to do matching */
     struct and_or_T   *ci_commands;  /* commands executed if match succeeds */
+    struct xfnmatch_T **ci_matchers; /* cache of compiled patterns */
+    unsigned long      ci_matchergen;
 } caseitem_T;
 /* `ci_patterns' is a NULL-terminated array of pointers to `wordunit_T' that are
- * cast to `void *'. */
+ * cast to `void *'.
+ * `ci_matchers' is NULL until the case command is first executed. It is then an
+ * array of the same length as `ci_patterns' whose elements are the compiled
+ * forms of the patterns that contain no expansions, or NULL for the other
+ * patterns. `ci_matchergen' is the value of `locale_generation' at the time the
+ * array was created. The array is discarded when they differ. */
 
 /* type of dbexp_T */
 typedef enum {
@@ -269,6 +276,7 @@ typedef enum {
 typedef struct assign_T {
     struct assign_T *next;
     assigntype_T a_type;
+    _Bool a_append;    /* true for `name+=value' */
     wchar_t *a_name;
     union {
 	struct wordunit_T *scalar;
@@ -384,6 +392,8 @@ static inline command_T *comsdup(command_T *c);
 extern void comsfree(command_T *c);
 extern void wordfree(wordunit_T *w);
 extern void paramfree(paramexp_T *p);
+extern void free_case_matchers(caseitem_T *ci)
+    __attribute__((nonnull));
 
 
 /* Duplicates the specified command (virtually). */
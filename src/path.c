@@ -351,6 +351,325 @@ int create_temporary_file(
 }
 
 
+/********** PATH Directory Index **********/
+
+/* The type of objects that remember the names of the files in a directory. */
+typedef struct dirindex_T {
+    unsigned di_misses;     /* the number of files that were not found in the
+			       directory before it was indexed */
+    bool di_indexed;        /* true if the members below are valid */
+    bool di_stable;         /* false if the directory may have been modified
+			       within the timestamp resolution after reading */
+    unsigned long di_validation;
+			    /* `dirindex_validation' when `di_stat' was last
+			       compared with the directory */
+    struct stat di_stat;    /* the result of `stat' before reading */
+    hashtable_T di_names;   /* the set of the file names in the directory */
+    char **di_executables;  /* the names of executable regular files */
+    char **di_others;       /* the names of the other files */
+    char di_path[];         /* the name of the directory */
+} dirindex_T;
+/* `di_executables' and `di_others' are NULL-terminated arrays of pointers to
+ * the keys of `di_names'. They are NULL until `get_dir_command_names' is called
+ * for the directory. */
+
+static bool is_indexed_executable_regular(const char *path)
+    __attribute__((nonnull));
+static dirindex_T *find_dirindex(const char *dirname)
+    __attribute__((nonnull));
+static bool update_dirindex(dirindex_T *di)
+    __attribute__((nonnull));
+static void classify_dirindex(dirindex_T *di)
+    __attribute__((nonnull));
+static bool read_dirindex(dirindex_T *di, const struct stat *st)
+    __attribute__((nonnull));
+static bool same_modification(const struct stat *st1, const struct stat *st2)
+    __attribute__((nonnull,pure));
+static void clear_dirindex(dirindex_T *di)
+    __attribute__((nonnull));
+static void free_dirindex(kvpair_T kv);
+static void forget_unused_dirindexes(char *const *paths);
+
+/* A directory is read and indexed only after this number of files have not
+ * been found in it, so that a shell that searches for only a few commands does
+ * not read large directories. */
+#ifndef DIRINDEX_MISS_THRESHOLD
+#define DIRINDEX_MISS_THRESHOLD 8
+#endif
+
+/* A hashtable that contains the indexes of absolute directories in $PATH.
+ * The keys are pointers to the `di_path' member of `dirindex_T' objects,
+ * which have no trailing slashes except for the root directory,
+ * and the values are pointers to the `dirindex_T' objects.
+ * The hashtable is initialized when a directory is indexed first. */
+static hashtable_T dirindexes;
+
+/* Incremented by `revalidate_dirindexes'.
+ * A directory index whose `di_validation' equals this value is trusted without
+ * checking the modification time of the directory. */
+static unsigned long dirindex_validation = 0;
+
+/* Checks if `path' is an executable regular file.
+ * If `path' is an absolute path and the directory containing the file has been
+ * indexed, the index is consulted first so that files that do not exist in the
+ * directory are rejected without searching the directory. */
+bool is_indexed_executable_regular(const char *path)
+{
+    if (path[0] == '/') {
+	const char *slash = strrchr(path, '/');
+	size_t dirlen = slash - path;
+	char dirname[dirlen + 2];
+	if (dirlen == 0) {
+	    dirname[dirlen++] = '/';
+	} else {
+	    memcpy(dirname, path, dirlen);
+	}
+	dirname[dirlen] = '\0';
+
+	dirindex_T *di = find_dirindex(dirname);
+	if (di->di_misses < DIRINDEX_MISS_THRESHOLD) {
+	    if (is_executable_regular(path))
+		return true;
+	    di->di_misses++;
+	    return false;
+	}
+	if (update_dirindex(di) && ht_get(&di->di_names, slash + 1).key == NULL)
+	    return false;
+    }
+    return is_executable_regular(path);
+}
+
+/* Gets the names of the files in the specified directory from its index.
+ * The names of executable regular files are assigned to `*executablesp' and
+ * those of the other files to `*othersp', both as NULL-terminated arrays.
+ * Whether a file is executable is checked when the directory is read, so the
+ * names in `*othersp' may have become executable since then; the caller should
+ * check them again if needed. The names of executable files, on the other hand,
+ * are not checked again because a file that has been removed or made
+ * non-executable changes the directory's modification time in most cases.
+ * The arrays are valid until the next call to a function that searches
+ * directories.
+ * Returns false if `dirname' is not a readable directory. */
+bool get_dir_command_names(const char *dirname,
+	char *const **executablesp, char *const **othersp)
+{
+    dirindex_T *di = find_dirindex(dirname);
+    if (!update_dirindex(di))
+	return false;
+    if (di->di_executables == NULL)
+	classify_dirindex(di);
+    *executablesp = di->di_executables;
+    *othersp = di->di_others;
+    return true;
+}
+
+/* Makes the directory indexes be compared with the directories again before
+ * they are used next.
+ * An index is otherwise trusted without examining the directory, so this
+ * function must be called whenever the directories may have been modified:
+ * when a child process exits, when the command hashtable is cleared, and before
+ * the shell reads a new command interactively. */
+void revalidate_dirindexes(void)
+{
+    dirindex_validation++;
+}
+
+/* Returns the index of the specified directory, creating a new one that has
+ * not yet read the directory if there is none. Trailing slashes in `dirname'
+ * are ignored so that a directory has only one index however it is written. */
+dirindex_T *find_dirindex(const char *dirname)
+{
+    if (dirindexes.capacity == 0)
+	ht_init(&dirindexes, hashstr, htstrcmp);
+
+    size_t len = strlen(dirname);
+    while (len > 1 && dirname[len - 1] == '/')
+	len--;
+
+    char trimmed[len + 1];
+    memcpy(trimmed, dirname, len);
+    trimmed[len] = '\0';
+
+    dirindex_T *di = ht_get(&dirindexes, trimmed).value;
+    if (di == NULL) {
+	di = xmallocs(sizeof *di, add(len, 1), sizeof *di->di_path);
+	di->di_misses = 0;
+	di->di_indexed = false;
+	strcpy(di->di_path, trimmed);
+	ht_set(&dirindexes, di->di_path, di);
+    }
+    return di;
+}
+
+/* Makes sure that the index reflects the current content of the directory.
+ * The directory is examined by `stat' only if the index is unstable or
+ * `revalidate_dirindexes' has been called since the last examination, and it
+ * is read only if it has not yet been indexed or it has been modified since it
+ * was indexed last.
+ * Returns false if the directory cannot be read. */
+bool update_dirindex(dirindex_T *di)
+{
+    if (di->di_indexed && di->di_stable
+	    && di->di_validation == dirindex_validation)
+	return true;
+
+    struct stat st;
+    if (stat(di->di_path, &st) < 0 || !S_ISDIR(st.st_mode)) {
+	clear_dirindex(di);
+	return false;
+    }
+    if (di->di_indexed && di->di_stable
+	    && same_modification(&di->di_stat, &st)) {
+	di->di_validation = dirindex_validation;
+	return true;
+    }
+
+    clear_dirindex(di);
+    return read_dirindex(di, &st);
+}
+
+/* Reads the directory into the index, which must not be indexed.
+ * `st' must be the result of `stat' for the directory.
+ * Returns false if the directory cannot be read. */
+bool read_dirindex(dirindex_T *di, const struct stat *st)
+{
+    assert(!di->di_indexed);
+
+    DIR *dir = opendir(di->di_path);
+    if (dir == NULL)
+	return false;
+
+    di->di_indexed = true;
+    di->di_stat = *st;
+    /* If the directory was modified in this second, another modification may
+     * follow without changing the modification time. */
+    di->di_stable = st->st_mtime < time(NULL);
+    di->di_validation = dirindex_validation;
+    ht_init(&di->di_names, hashstr, htstrcmp);
+    di->di_executables = di->di_others = NULL;
+
+    struct dirent *de;
+    while (errno = 0, (de = readdir(dir)) != NULL) {
+	if (de->d_name[0] == '.' && (de->d_name[1] == '\0' ||
+		    (de->d_name[1] == '.' && de->d_name[2] == '\0')))
+	    continue;
+	ht_set(&di->di_names, xstrdup(de->d_name), NULL);
+    }
+    if (errno != 0)
+	clear_dirindex(di);
+    closedir(dir);
+    return di->di_indexed;
+}
+
+/* Sorts the file names of the directory index into `di_executables' and
+ * `di_others'. */
+void classify_dirindex(dirindex_T *di)
+{
+    plist_T executables, others;
+    xstrbuf_T path;
+    size_t dirlen;
+
+    pl_initwithmax(&executables, di->di_names.count);
+    pl_init(&others);
+    sb_init(&path);
+    sb_cat(&path, di->di_path);
+    if (path.length > 0 && path.contents[path.length - 1] != '/')
+	sb_ccat(&path, '/');
+    dirlen = path.length;
+
+    kvpair_T kv;
+    size_t index = 0;
+    while ((kv = ht_next(&di->di_names, &index)).key != NULL) {
+	sb_cat(&path, kv.key);
+	if (is_executable_regular(path.contents))
+	    pl_add(&executables, kv.key);
+	else
+	    pl_add(&others, kv.key);
+	sb_truncate(&path, dirlen);
+    }
+
+    sb_destroy(&path);
+    di->di_executables = (char **) pl_toary(&executables);
+    di->di_others = (char **) pl_toary(&others);
+}
+
+/* Checks if the two stat results refer to the same file with the same
+ * modification time. */
+bool same_modification(const struct stat *st1, const struct stat *st2)
+{
+    return stat_result_same_file(st1, st2)
+	&& st1->st_mtime == st2->st_mtime
+#if HAVE_ST_MTIM
+	&& st1->st_mtim.tv_nsec == st2->st_mtim.tv_nsec
+#elif HAVE_ST_MTIMESPEC
+	&& st1->st_mtimespec.tv_nsec == st2->st_mtimespec.tv_nsec
+#elif HAVE_ST_MTIMENSEC
+	&& st1->st_mtimensec == st2->st_mtimensec
+#elif HAVE___ST_MTIMENSEC
+	&& st1->__st_mtimensec == st2->__st_mtimensec
+#endif
+	;
+}
+
+/* Discards the file names read into the directory index. */
+void clear_dirindex(dirindex_T *di)
+{
+    if (di->di_indexed) {
+	free(di->di_executables);
+	free(di->di_others);
+	ht_clear(&di->di_names, kfree);
+	ht_destroy(&di->di_names);
+	di->di_indexed = false;
+    }
+}
+
+/* Frees the directory index that is the value of the specified pair.
+ * Does nothing if the value is NULL. */
+void free_dirindex(kvpair_T kv)
+{
+    dirindex_T *di = kv.value;
+    if (di != NULL) {
+	clear_dirindex(di);
+	free(di);
+    }
+}
+
+/* Discards the indexes of directories that are not contained in `paths'. */
+void forget_unused_dirindexes(char *const *paths)
+{
+    if (dirindexes.capacity == 0)
+	return;
+
+    plist_T unused;
+    pl_init(&unused);
+
+    kvpair_T kv;
+    size_t index = 0;
+    while ((kv = ht_next(&dirindexes, &index)).key != NULL) {
+	/* The key has no trailing slashes while the element of $PATH may
+	 * have some. */
+	size_t keylen = strlen(kv.key);
+	bool used = false;
+	if (paths != NULL) {
+	    for (char *const *p = paths; !used && *p != NULL; p++) {
+		if (strncmp(*p, kv.key, keylen) == 0) {
+		    const char *rest = &(*p)[keylen];
+		    while (*rest == '/')
+			rest++;
+		    used = *rest == '\0';
+		}
+	    }
+	}
+	if (!used)
+	    pl_add(&unused, kv.key);
+    }
+
+    for (size_t i = 0; i < unused.length; i++)
+	free_dirindex(ht_remove(&dirindexes, unused.contents[i]));
+    pl_destroy(&unused);
+}
+
+
 /********** Command Hashtable **********/
 
 static inline void forget_command_path(const char *command)
@@ -375,17 +694,23 @@ void init_cmdhash(void)
     ht_init(&cmdhash, hashstr, htstrcmp);
 }
 
-/* Empties the command hashtable. */
+/* Empties the command hashtable.
+ * The indexes of directories that are not in the current $PATH are discarded
+ * while the others are kept to speed up subsequent searches. The kept indexes
+ * are compared with the directories again before they are used next. */
 void clear_cmdhash(void)
 {
     ht_clear(&cmdhash, vfree);
+    forget_unused_dirindexes(get_path_array(PA_PATH));
+    revalidate_dirindexes();
 }
 
 /* Searches PATH for the specified command and returns its full pathname.
  * If `forcelookup' is false and the command is already entered in the command
  * hashtable, the value in the hashtable is returned. Otherwise, `which' is
  * called to search for the command, the result is entered into the hashtable,
- * and then it is returned. If no command is found, NULL is returned. */
+ * and then it is returned. If no command is found, NULL is returned.
+ * Absolute directories in PATH are searched using their directory indexes. */
 const char *get_command_path(const char *name, bool forcelookup)
 {
     const char *path;
@@ -396,7 +721,7 @@ const char *get_command_path(const char *name, bool forcelookup)
 	    return path;
     }
 
-    path = which(name, get_path_array(PA_PATH), is_executable_regular);
+    path = which(name, get_path_array(PA_PATH), is_indexed_executable_regular);
     if (path != NULL) {
 	size_t namelen = strlen(name), pathlen = strlen(path);
 	const char *nameinpath = path + pathlen - namelen;
@@ -615,10 +940,16 @@ static void wglob_search_recsearch(
 	plist_T *restrict list,
 	struct wglob_dirstack *dirstack)
     __attribute__((nonnull(1,3,4,5)));
+static bool wglob_entry_is_directory(
+	DIR *dir, const struct dirent *de, const char *path)
+    __attribute__((nonnull));
+static int wglob_stat_entry(DIR *dir, const struct dirent *de,
+	const char *path, bool followlink, struct stat *st)
+    __attribute__((nonnull));
 static bool is_reentry(
 	const struct stat *st, const struct wglob_dirstack *dirstack)
     __attribute__((nonnull(1)));
-static int wglob_sortcmp(const void *v1, const void *v2)
+static const wchar_t *wglob_sortstr(const void *elem)
     __attribute__((pure,nonnull));
 
 /* A wide string version of `glob'.
@@ -662,8 +993,8 @@ bool wglob(const wchar_t *restrict pattern, enum wglobflags_T flags,
 	size_t count = list->length - listbase;  /* # of resulting items */
 	if (count > 0) {
 	    /* sort the items */
-	    qsort(list->contents + listbase, count, sizeof (void *),
-		    wglob_sortcmp);
+	    sort_by_collation(list->contents + listbase, count,
+		    sizeof *list->contents, wglob_sortstr, NULL);
 
 	    /* remove duplicates */
 	    for (size_t i = list->length; --i > listbase; ) {
@@ -874,7 +1205,7 @@ void wglob_search_match(
 	    sb_cat(path, de->d_name);
 	    if (pattern->next == NULL) {
 		if (flags & WGLB_MARK) {
-		    if (is_directory(path->contents))
+		    if (wglob_entry_is_directory(dir, de, path->contents))
 			wb_wccat(wpath, L'/');
 		}
 		pl_add(list, xwcsdup(wpath->contents));
@@ -917,18 +1248,33 @@ void wglob_search_recsearch(
 
     const size_t savepathlen = path->length;
     const size_t savewpathlen = wpath->length;
+    const bool followlink = pattern->value.recsearch.followlink;
     struct dirent *de;
-    int (*statfunc)(const char *path, struct stat *st) =
-	pattern->value.recsearch.followlink ? stat : lstat;
     while ((de = readdir(dir)) != NULL) {
 	if (pattern->value.recsearch.allowperiod
 		? strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0
 		: de->d_name[0] == '.')
 	    continue;
+#if HAVE_D_TYPE
+	/* Skip entries that are known not to be a directory without calling
+	 * `stat'. Directories still have to be stat'ed for `is_reentry'. */
+	switch (de->d_type) {
+	    case DT_DIR:
+	    case DT_UNKNOWN:
+		break;
+	    case DT_LNK:
+		if (followlink)
+		    break;
+		/* falls thru! */
+	    default:
+		continue;
+	}
+#endif
 
 	struct wglob_dirstack newstack;
 	sb_cat(path, de->d_name);
-	if (statfunc(path->contents, &newstack.st) >= 0
+	if (wglob_stat_entry(dir, de, path->contents, followlink,
+		    &newstack.st) >= 0
 		&& S_ISDIR(newstack.st.st_mode)
 		&& !is_reentry(&newstack.st, dirstack)) {
 
@@ -947,6 +1293,47 @@ next:
     closedir(dir);
 }
 
+/* Returns true iff directory entry `de' read from `dir' is a directory or a
+ * symbolic link to a directory. `path' is the pathname of the entry.
+ * The file type in the entry is used if available to avoid `stat'. */
+bool wglob_entry_is_directory(
+	DIR *dir, const struct dirent *de, const char *path)
+{
+#if HAVE_D_TYPE
+    switch (de->d_type) {
+	case DT_DIR:
+	    return true;
+	case DT_LNK:
+	case DT_UNKNOWN:
+	    break;
+	default:
+	    return false;
+    }
+#endif
+
+    struct stat st;
+    return wglob_stat_entry(dir, de, path, true, &st) >= 0
+	&& S_ISDIR(st.st_mode);
+}
+
+/* Calls `stat' (if `followlink' is true) or `lstat' (otherwise) for directory
+ * entry `de' read from `dir'. `path' is the pathname of the entry.
+ * If possible, the entry is looked up relative to the directory's file
+ * descriptor so that the kernel need not resolve the whole `path' again. */
+int wglob_stat_entry(DIR *dir, const struct dirent *de,
+	const char *path, bool followlink, struct stat *st)
+{
+#if HAVE_FSTATAT
+    int fd = dirfd(dir);
+    if (fd >= 0)
+	return fstatat(fd, de->d_name, st,
+		followlink ? 0 : AT_SYMLINK_NOFOLLOW);
+#else
+    (void) dir, (void) de;
+#endif
+    return (followlink ? stat : lstat)(path, st);
+}
+
 /* Returns true iff the file designated by `st' is contained in `dirstack'. */
 bool is_reentry(const struct stat *st, const struct wglob_dirstack *dirstack)
 {
@@ -956,9 +1343,9 @@ bool is_reentry(const struct stat *st, const struct wglob_dirstack *dirstack)
     return false;
 }
 
-int wglob_sortcmp(const void *v1, const void *v2)
+const wchar_t *wglob_sortstr(const void *elem)
 {
-    return wcscoll(*(const wchar_t *const *) v1, *(const wchar_t *const *) v2);
+    return *(const wchar_t *const *) elem;
 }
 
 
@@ -1192,6 +1579,8 @@ step10:  /* do chdir */
     /* set $OLDPWD and $PWD */
     if (origpwd != NULL)
 	set_variable(L VAR_OLDPWD, xwcsdup(origpwd), SCOPE_GLOBAL, false);
+    if (printnewdir)
+	flush_stdout();
     if (logical) {
 	if (!posixly_correct)
 	    canonicalize_path_ex(&curpath);
@@ -1375,6 +1764,7 @@ int pwd_builtin(int argc __attribute__((unused)), void **argv)
 	return Exit_FAILURE;
     }
 print:
+    flush_stdout();
     if (printf("%s\n", mbspwd) < 0)
 	xerror(errno, Ngt("cannot print to the standard output"));
     free(mbspwd);
@@ -68,6 +68,14 @@ extern int create_temporary_file(
     __attribute__((nonnull));
 
 
+/********** PATH Directory Index **********/
+
+extern _Bool get_dir_command_names(const char *dirname,
+	char *const **executablesp, char *const **othersp)
+    __attribute__((nonnull));
+extern void revalidate_dirindexes(void);
+
+
 /********** Command Hashtable **********/
 
 extern void init_cmdhash(void);
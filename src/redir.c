@@ -51,6 +51,92 @@
 #include "yash.h"
 
 
+/********** Standard Output Buffer **********/
+
+static void flush_stdout_before_change(void);
+
+/* The "echo" and "printf" built-ins do not write their output to the standard
+ * output directly but append it to `stdoutbuf' so that a loop printing many
+ * lines does not issue a system call for each line. The buffered output is
+ * written by `flush_stdout' before anything else is written to the standard
+ * output, before the file descriptor is changed, before another process is
+ * started, before a trap is executed, and before the shell blocks reading
+ * input, waits for jobs, or exits. */
+
+#ifndef STDOUTBUFSIZE
+#define STDOUTBUFSIZE 8192  /* size of `stdoutbuf' */
+#endif
+
+/* The output of built-ins that has not yet been written. */
+static char stdoutbuf[STDOUTBUFSIZE];
+/* The number of bytes in `stdoutbuf'. */
+static size_t stdoutbuflength = 0;
+/* True iff output has been successfully written to the current standard
+ * output. While this is false, output is written without buffering so that the
+ * built-in can report an error in the file descriptor. */
+static bool stdout_writable = false;
+
+/* Writes `size' bytes of `data' to the standard output, buffering it in
+ * `stdoutbuf' if the standard output has been written successfully.
+ * Returns true iff successful. On error, false is returned with `errno' set.
+ * An error may be caused by output buffered by an earlier call. */
+bool write_stdout_buffered(const void *data, size_t size)
+{
+    if (stdout_writable && size <= STDOUTBUFSIZE - stdoutbuflength) {
+	memcpy(&stdoutbuf[stdoutbuflength], data, size);
+	stdoutbuflength += size;
+	return true;
+    }
+
+    size_t length = stdoutbuflength;
+    stdoutbuflength = 0;
+    if (fflush(stdout) != 0 || !write_all(STDOUT_FILENO, stdoutbuf, length)) {
+	stdout_writable = false;
+	return false;
+    }
+
+    if (stdout_writable && size <= STDOUTBUFSIZE) {
+	memcpy(stdoutbuf, data, size);
+	stdoutbuflength = size;
+	return true;
+    }
+    stdout_writable = write_all(STDOUT_FILENO, data, size);
+    return stdout_writable;
+}
+
+/* Writes the output buffered by `write_stdout_buffered' to the standard output.
+ * This function must be called before anything is written to the standard
+ * output or the standard error by other means.
+ * An error message is printed on error. */
+void flush_stdout(void)
+{
+    if (stdoutbuflength == 0)
+	return;
+
+    size_t length = stdoutbuflength;
+    stdoutbuflength = 0;
+    fflush(stdout);
+    if (!write_all(STDOUT_FILENO, stdoutbuf, length)) {
+	stdout_writable = false;
+	xerror(errno, Ngt("cannot print to the standard output"));
+    }
+}
+
+/* Returns true iff `stdoutbuf' contains output not yet written. */
+bool stdout_buffer_pending(void)
+{
+    return stdoutbuflength > 0;
+}
+
+/* Flushes the buffered output before the standard output is closed or replaced
+ * with another file descriptor. */
+void flush_stdout_before_change(void)
+{
+    flush_stdout();
+    stdout_writable = false;
+}
+
+
 /********** Utilities **********/
 
 /* Closes the specified file descriptor surely.
@@ -60,6 +146,10 @@
  * printed. */
 int xclose(int fd)
 {
+    if (fd == STDIN_FILENO)
+	unread_input(stdin_input_file_info, true);
+    if (fd == STDOUT_FILENO)
+	flush_stdout_before_change();
     while (close(fd) < 0) {
 	switch (errno) {
 	case EINTR:
@@ -292,14 +382,16 @@ struct savefd_T {
     int  sf_origfd;            /* original file descriptor */
     int  sf_copyfd;            /* copied file descriptor */
     bool sf_stdin_redirected;  /* original `is_stdin_redirected' */
+    char *sf_readahead;        /* input read ahead from the original stdin */
+    size_t sf_readaheadlength; /* number of bytes in `sf_readahead' */
 };
+/* Bytes that the "read" built-in has read ahead from the standard input (see
+ * `unread_input') are kept in `sf_readahead' while the standard input is
+ * redirected and put back into `stdin_input_file_info' when the redirection is
+ * undone. `sf_readahead' is NULL if there are no such bytes. */
 
-static char *expand_redir_filename(const struct wordunit_T *filename)
-    __attribute__((malloc,warn_unused_result));
 static void save_fd(int oldfd, savefd_T **save)
     __attribute__((nonnull));
-static int open_file(const char *path, int oflag)
-    __attribute__((nonnull));
 #if YASH_ENABLE_SOCKET
 static int open_socket(const char *hostandport, int socktype)
     __attribute__((nonnull));
@@ -477,6 +569,18 @@ void save_fd(int fd, savefd_T **save)
     s->sf_origfd = fd;
     s->sf_copyfd = copyfd;
     s->sf_stdin_redirected = is_stdin_redirected;
+    s->sf_readahead = NULL;
+    if (fd == STDIN_FILENO && copyfd >= 0) {
+	struct input_file_info_T *info = stdin_input_file_info;
+	unread_input(info, false);
+	if (info->bufpos < info->bufmax) {
+	    s->sf_readaheadlength = info->bufmax - info->bufpos;
+	    s->sf_readahead = xmalloc(s->sf_readaheadlength);
+	    memcpy(s->sf_readahead, &info->buf[info->bufpos],
+		    s->sf_readaheadlength);
+	    info->bufpos = info->bufmax = 0;
+	}
+    }
     *save = s;
 }
 
@@ -901,6 +1005,14 @@ void undo_redirections(savefd_T *save)
 	    xclose(save->sf_origfd);
 	}
 	is_stdin_redirected = save->sf_stdin_redirected;
+	if (save->sf_readahead != NULL) {
+	    struct input_file_info_T *info = stdin_input_file_info;
+	    assert(save->sf_readaheadlength <= info->bufsize);
+	    memcpy(info->buf, save->sf_readahead, save->sf_readaheadlength);
+	    info->bufpos = 0;
+	    info->bufmax = save->sf_readaheadlength;
+	    free(save->sf_readahead);
+	}
 
 	savefd_T *next = save->next;
 	free(save);
@@ -917,6 +1029,7 @@ void clear_savefd(savefd_T *save)
 	    remove_shellfd(save->sf_copyfd);
 	    xclose(save->sf_copyfd);
 	}
+	free(save->sf_readahead);
 
 	savefd_T *next = save->next;
 	free(save);
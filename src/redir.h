@@ -27,6 +27,12 @@ extern int xdup2(int oldfd, int newfd);
 extern _Bool write_all(int fd, const void *data, size_t size)
     __attribute__((nonnull));
 
+extern _Bool write_stdout_buffered(const void *data, size_t size)
+    __attribute__((nonnull));
+extern void flush_stdout(void);
+extern _Bool stdout_buffer_pending(void)
+    __attribute__((pure));
+
 extern int ttyfd;
 
 extern void init_shellfds(void);
@@ -42,12 +48,17 @@ extern int get_ttyfd(void) __attribute__((pure));
 
 typedef struct savefd_T savefd_T;
 struct redir_T;
+struct wordunit_T;
 
 extern _Bool open_redirections(const struct redir_T *r, savefd_T **save)
     __attribute__((nonnull(2)));
 extern void undo_redirections(savefd_T *save);
 extern void clear_savefd(savefd_T *save);
 extern void maybe_redirect_stdin_to_devnull(void);
+extern char *expand_redir_filename(const struct wordunit_T *filename)
+    __attribute__((malloc,warn_unused_result));
+extern int open_file(const char *path, int oflag)
+    __attribute__((nonnull));
 
 #define PIPE_IN  0   /* index of the reading end of a pipe */
 #define PIPE_OUT 1   /* index of the writing end of a pipe */
@@ -85,6 +85,11 @@ static int parse_signal_number(const wchar_t *number)
 static void set_special_handler(int signum, void (*handler)(int signum));
 static void reset_special_handler(
 	int signum, void (*handler)(int signum), bool leave);
+#if HAVE_POSIX_SPAWN
+static bool add_spawn_default(
+	int signum, void (*handler)(int signum), sigset_t *defaults)
+    __attribute__((nonnull));
+#endif
 static void sig_handler(int signum);
 static void handle_sigchld(void);
 static void set_trap(int signum, const wchar_t *command);
@@ -376,6 +381,59 @@ void restore_signals(bool leave)
     }
 }
 
+#if HAVE_POSIX_SPAWN
+
+/* Computes the signal settings that `restore_signals(true)' would establish
+ * for an external command so that the command can be started by `posix_spawn'
+ * without forking the shell.
+ * The signals whose actions should be reset to the default are added to
+ * `*defaults' and the signal mask is assigned to `*mask'. Signals caught by the
+ * shell are not added because exec resets them anyway.
+ * Returns false if the settings cannot be represented this way, that is, if a
+ * signal caught by the shell should be ignored in the command. */
+bool get_spawn_signal_settings(sigset_t *defaults, sigset_t *mask)
+{
+    bool ok = true;
+
+    if (job_handlers_set) {
+	ok &= add_spawn_default(SIGTTIN, SIG_IGN, defaults);
+	ok &= add_spawn_default(SIGTTOU, SIG_IGN, defaults);
+	ok &= add_spawn_default(SIGTSTP, SIG_IGN, defaults);
+    }
+    if (interactive_handlers_set) {
+	ok &= add_spawn_default(SIGINT, sig_handler, defaults);
+	ok &= add_spawn_default(SIGTERM, SIG_IGN, defaults);
+	ok &= add_spawn_default(SIGQUIT, SIG_IGN, defaults);
+#if YASH_ENABLE_LINEEDIT && defined(SIGWINCH)
+	ok &= add_spawn_default(SIGWINCH, sig_handler, defaults);
+#endif
+    }
+    if (main_handler_set) {
+	ok &= add_spawn_default(SIGCHLD, sig_handler, defaults);
+	*mask = original_sigmask;
+    } else {
+	sigprocmask(SIG_SETMASK, NULL, mask);
+    }
+    return ok;
+}
+
+/* Adds `signum' to `*defaults' if `reset_special_handler(signum, handler,
+ * true)' would reset the action for the signal to the default.
+ * Returns false if the action should be SIG_IGN but the signal is caught. */
+bool add_spawn_default(
+	int signum, void (*handler)(int signum), sigset_t *defaults)
+{
+    if (sigismember(&ignored_signals, signum))
+	return handler == SIG_IGN;
+    if (sigismember(&trapped_signals, signum))
+	return true;
+    if (handler == SIG_IGN)
+	sigaddset(defaults, signum);
+    return true;
+}
+
+#endif /* HAVE_POSIX_SPAWN */
+
 /* Re-sets the signal handler for SIGTTIN, SIGTTOU, and SIGTSTP according to the
  * current `doing_job_control_now' and `job_handlers_set'. */
 void reset_job_signals(void)
@@ -493,6 +551,7 @@ void ignore_sigtstp(void)
  * On error, an error message is printed to the standard error. */
 void stop_myself(void)
 {
+    flush_stdout();
     if (kill(0, SIGSTOP) < 0)
 	xerror(errno, Ngt("cannot send SIGSTOP signal"));
 }
@@ -722,6 +781,7 @@ int handle_traps(void)
 #if YASH_ENABLE_LINEEDIT
 		    le_suspend_readline();
 #endif
+		    flush_stdout();
 		    struct execstate_T *execstate = save_execstate();
 		    reset_execstate(true);
 		    signum = handled_signal = s->no;
@@ -746,6 +806,7 @@ int handle_traps(void)
 #if YASH_ENABLE_LINEEDIT
 		    le_suspend_readline();
 #endif
+		    flush_stdout();
 		    struct execstate_T *execstate = save_execstate();
 		    reset_execstate(true);
 		    signum = handled_signal = sigrtmin + i;
@@ -1379,6 +1440,9 @@ main:
 	if (optind == argc)
 	    return insufficient_operands_error(1);
 
+	/* The signal may terminate the shell itself. */
+	flush_stdout();
+
 	do {
 	    wchar_t *proc = ARGV(optind);
 	    if (proc[0] == L'%') {
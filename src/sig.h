@@ -20,6 +20,9 @@
 #define YASH_SIG_H
 
 #include <stddef.h>
+#if HAVE_POSIX_SPAWN
+# include <signal.h>
+#endif
 #include <sys/types.h>
 #include "xgetopt.h"
 
@@ -37,6 +40,10 @@ extern _Bool any_trap_set;
 extern void init_signal(void);
 extern void set_signals(void);
 extern void restore_signals(_Bool leave);
+#if HAVE_POSIX_SPAWN
+extern _Bool get_spawn_signal_settings(sigset_t *defaults, sigset_t *mask)
+    __attribute__((nonnull));
+#endif
 extern void reset_job_signals(void);
 extern void set_interruptible_by_sigint(_Bool onoff);
 extern void ignore_sigquit_and_sigint(void);
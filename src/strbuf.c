@@ -444,6 +444,52 @@ char *wb_mbscat(xwcsbuf_T *restrict buf, const char *restrict s)
     return (char *) s;
 }
 
+/* Converts the first `n' bytes of multibyte string `s' into wide characters and
+ * appends them to buffer `buf'. Null bytes are converted into null characters
+ * and appended like other characters.
+ * `state' holds the shift state, which is carried over between calls so that a
+ * multibyte character may be split into two consecutive calls.
+ * If `asciicompat' is true, which should be the result of
+ * `is_ascii_compatible_encoding', bytes that represent ASCII characters are
+ * converted without calling `mbrtowc'.
+ * Returns the number of bytes that have been converted (including the bytes of
+ * an incomplete character at the end, which are kept in `state'). The return
+ * value is less than `n' only if an invalid multibyte sequence is found. */
+size_t wb_mbsncat(xwcsbuf_T *restrict buf, const char *restrict s, size_t n,
+	mbstate_t *restrict state, bool asciicompat)
+{
+    wb_ensuremax(buf, add(buf->length, n));
+
+    wchar_t *out = &buf->contents[buf->length];
+    bool fast = asciicompat && mbsinit(state);
+    size_t i = 0;
+    while (i < n) {
+	if (fast && (unsigned char) s[i] < 0x80) {
+	    *out++ = (unsigned char) s[i++];
+	    continue;
+	}
+
+	size_t count = mbrtowc(out, &s[i], n - i, state);
+	switch (count) {
+	    case 0:            /* null character */
+		count = 1;
+		break;
+	    case (size_t) -1:  /* invalid sequence */
+		goto end;
+	    case (size_t) -2:  /* incomplete character */
+		i = n;
+		goto end;
+	}
+	out++;
+	i += count;
+	fast = asciicompat;
+    }
+end:
+    buf->length = out - buf->contents;
+    buf->contents[buf->length] = L'\0';
+    return i;
+}
+
 /* Appends the result of `vswprintf' to the specified buffer.
  * `format' and the following arguments must not be part of `buf->contents'.
  * Returns the number of appended characters if successful.
@@ -644,5 +690,24 @@ wchar_t *joinwcsarray(void *const *array, const wchar_t *padding)
     return result;
 }
 
+/* Checks if the multibyte encoding of the current locale is stateless and
+ * represents each ASCII character as a single byte of the same value.
+ * If so, such bytes can be converted to wide characters without `mbrtowc'. */
+bool is_ascii_compatible_encoding(void)
+{
+    if (mblen(NULL, 0) != 0)  /* state-dependent encoding */
+	return false;
+
+    for (int c = 1; c < 0x80; c++) {
+	char mb = (char) c;
+	wchar_t wc;
+	mbstate_t state;
+	memset(&state, 0, sizeof state);  // initialize as the initial shift state
+	if (mbrtowc(&wc, &mb, 1, &state) != 1 || wc != (wchar_t) c)
+	    return false;
+    }
+    return true;
+}
+
 
 /* vim: set ts=8 sts=4 sw=4 noet tw=80: */
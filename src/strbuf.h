@@ -158,6 +158,9 @@ extern xwcsbuf_T *wb_wccat(xwcsbuf_T *buf, wchar_t c)
     __attribute__((nonnull));
 extern char *wb_mbscat(xwcsbuf_T *restrict buf, const char *restrict s)
     __attribute__((nonnull));
+extern size_t wb_mbsncat(xwcsbuf_T *restrict buf, const char *restrict s,
+	size_t n, mbstate_t *restrict state, _Bool asciicompat)
+    __attribute__((nonnull));
 extern int wb_vwprintf(
 	xwcsbuf_T *restrict buf, const wchar_t *restrict format, va_list ap)
     __attribute__((nonnull(1,2)));
@@ -193,6 +196,8 @@ extern wchar_t *malloc_wprintf(const wchar_t *format, ...)
 extern wchar_t *joinwcsarray(void *const *array, const wchar_t *padding)
     __attribute__((malloc,warn_unused_result,nonnull));
 
+extern _Bool is_ascii_compatible_encoding(void);
+
 
 /* Frees the specified multibyte string buffer. The contents are lost. */
 void sb_destroy(xstrbuf_T *buf)
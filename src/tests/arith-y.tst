@@ -315,6 +315,53 @@ __IN__
 eval: arithmetic: a value is missing
 __ERR__
 
+test_oE -e 0 'repeated evaluation of same expression'
+i=0 sum=0
+while [ $((i+=1)) -le 5 ]; do
+    echoraw $((sum += i * i)) $((i % 2 ? i : -i))
+done
+__IN__
+1 1
+5 -2
+14 3
+30 -4
+55 5
+__OUT__
+
+test_oE -e 0 'repeated short-circuit evaluation'
+for x in 0 1 2.5; do
+    echoraw $((x && (a=x))) $((x || (b=x))) $((x ? (c=x) : (d=x)))
+done
+echoraw $a $b $c $d
+__IN__
+0 0 0
+1 1 1
+1 1 2.5
+2.5 0 2.5 0
+__OUT__
+
+test_oE -e 0 'conditional assignment target'
+for c in 1 0; do
+    echoraw $(((c ? x : y) = c + 10))
+done
+echoraw $x $y
+__IN__
+11
+10
+11 10
+__OUT__
+
+test_Oe -e 2 'cached expression in POSIXly-correct mode'
+a=1
+echoraw $((a++)) >/dev/null
+set -o posixlycorrect
+eval 'echoraw $((a++))'
+__IN__
+eval: arithmetic: operator `++' is not supported
+__ERR__
+#'
+#`
+
 (
 posix=true
 
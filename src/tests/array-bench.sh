@@ -0,0 +1,84 @@
+# array-bench.sh: benchmark of arrays
+# vim: set ts=8 sts=4 sw=4 noet:
+
+# Reads every element of an array one by one in a loop
+# $1 = number of elements
+array_index_bench() {
+    a=($(awk -v n="$1" 'BEGIN { for (i = 1; i <= n; i++) print i }'))
+    bench "\${a[i]} over $1 elements" - eval '
+    i=1
+    while [ "$i" -le "${a[#]}" ]; do
+	x=${a[i]}
+	i=$((i+1))
+    done'
+    bench "\${a[i,i+9]} over $1 elements" - eval '
+    i=1
+    while [ "$i" -le "${a[#]}" ]; do
+	x="${a[i,i+9]}"
+	i=$((i+10))
+    done'
+    unset a i x
+}
+
+# Reads every positional parameter one by one in a loop
+# $1 = number of parameters
+positional_index_bench() {
+    positional_index_loop() {
+	i=1
+	while [ "$i" -le "$#" ]; do
+	    x=${@[i]}
+	    i=$((i+1))
+	done
+    }
+    bench "\${@[i]} over $1 parameters" - positional_index_loop \
+	$(awk -v n="$1" 'BEGIN { for (i = 1; i <= n; i++) print i }')
+    unset -f positional_index_loop
+    unset i x
+}
+
+# Consumes all positional parameters one by one from the front
+# $1 = number of parameters
+shift_bench() {
+    shift_loop() {
+	while [ "$#" -gt 0 ]; do
+	    shift
+	done
+    }
+    bench "shift over $1 parameters" - shift_loop \
+	$(awk -v n="$1" 'BEGIN { for (i = 1; i <= n; i++) print i }')
+    unset -f shift_loop
+}
+
+# Uses an array as a queue and a stack with elements added and removed at
+# either end
+# $1 = number of elements
+array_deque_bench() {
+    bench "array -i 0, shift -A over $1 elements" - eval '
+    a=() i=0
+    while [ "$i" -lt '"$1"' ]; do
+	array -i a 0 "$i"
+	i=$((i+1))
+    done
+    while [ "${a[#]}" -gt 0 ]; do
+	shift -A a
+    done'
+    bench "array -i -1, array -d -1 over $1 elements" - eval '
+    a=() i=0
+    while [ "$i" -lt '"$1"' ]; do
+	array -i a -1 "$i"
+	i=$((i+1))
+    done
+    while [ "${a[#]}" -gt 0 ]; do
+	array -d a -1
+    done'
+    unset a i
+}
+
+array_index_bench 1000
+array_index_bench 100000
+positional_index_bench 1000
+positional_index_bench 100000
+shift_bench 1000
+shift_bench 100000
+array_deque_bench 1000
+array_deque_bench 100000
@@ -252,6 +252,26 @@ __IN__
 [I][J][1][2  2][3]
 __OUT__
 
+test_oE -e 0 'inserting and deleting array elements at both ends repeatedly'
+i=0
+while [ "$i" -lt 100 ]; do
+    array -i a 0 "$i"
+    array -i a -1 "$i"
+    i=$((i+1))
+done
+echo "${a[#]}" "${a[1]}" "${a[-1]}"
+while [ "$i" -gt 1 ]; do
+    array -d a 1 -1
+    i=$((i-1))
+done
+shift -A a -1
+shift -A a
+bracket "$a"
+__IN__
+203 99 99
+[1][2  2][3]
+__OUT__
+
 test_Oe -e n 'inserting array elements (nonexistent array)'
 array -i x 1 ''
 __IN__
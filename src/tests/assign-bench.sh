@@ -0,0 +1,26 @@
+# assign-bench.sh: benchmark of variable assignment
+# vim: set ts=8 sts=4 sw=4 noet:
+
+# Builds a string by appending lines one by one
+# $1 = size of the resulting string in bytes
+# $2 = name of the measurement
+# $3 = assignment that appends $line to $out
+append_bench() {
+    line='abcdefghijklmnopqrstuvwxyz0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ_'
+    count=$(($1 / (${#line} + 1)))
+    out=
+    bench "$2 $(($1 / 1048576))MB" "$1" eval '
+    i=0
+    while [ "$i" -lt "$count" ]; do
+	'"$3"'
+	i=$((i+1))
+    done'
+    unset line count out i
+}
+
+append_bench 1048576  'out=$out$line' 'out="$out$line
+"'
+append_bench 10485760 'out=$out$line' 'out="$out$line
+"'
+append_bench 10485760 'out+=$line' 'out+="$line
+"'
@@ -26,6 +26,40 @@ expanded 0
 expanded 1
 __ERR__
 
+test_oE 'constant and expanded patterns in repeated execution'
+for p in 'b*' 'c*'; do
+    for w in a1 b1 c1 '*'; do
+	case $w in
+	    (a?) echo "$w: constant";;
+	    ($p) echo "$w: $p";;
+	    (\*) echo "$w: escaped";;
+	    (*) echo "$w: unmatched";;
+	esac
+    done
+done
+__IN__
+a1: constant
+b1: b*
+c1: unmatched
+*: escaped
+a1: constant
+b1: unmatched
+c1: c*
+*: escaped
+__OUT__
+
+test_oE 'tilde in pattern is expanded in each execution'
+for HOME in /x /y; do
+    case /y/z in
+	(~/z) echo $HOME: matched;;
+	(*) echo $HOME: unmatched;;
+    esac
+done
+__IN__
+/x: unmatched
+/y: matched
+__OUT__
+
 # The behavior is unspecified in POSIX, but many existing shells seem to behave
 # this way (with the notable exception of ksh).
 test_OE -e 0 'exit status of case command (matched, empty)'
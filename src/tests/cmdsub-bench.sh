@@ -0,0 +1,44 @@
+# cmdsub-bench.sh: benchmark of command substitution
+# vim: set ts=8 sts=4 sw=4 noet:
+
+# Throughput of reading the output of command substitution
+# $1 = size of the output in bytes
+# $2 = line of the output
+cmdsub_bench() {
+    make_data_file data "$1" "$2"
+    size="$(wc -c <data)"
+    bench "\$(cat) $3 $(($1 / 1048576))MB" "$size" eval 'output="$(cat data)"'
+    bench "\$(<) $3 $(($1 / 1048576))MB" "$size" eval 'output="$(<data)"'
+    unset output
+    rm -f data
+}
+
+# Reads a small file by command substitution many times
+# $1 = number of iterations
+file_cmdsub_bench() {
+    printf 'key=value\n' >data
+    bench "\$(cat) of small file $1 times" - eval '
+    i=0
+    while [ $i -lt '"$1"' ]; do
+	output="$(cat data)"
+	i=$((i+1))
+    done'
+    bench "\$(<) of small file $1 times" - eval '
+    i=0
+    while [ $i -lt '"$1"' ]; do
+	output="$(<data)"
+	i=$((i+1))
+    done'
+    unset i output
+    rm -f data
+}
+
+file_cmdsub_bench 1000
+
+cmdsub_bench 1048576   'abcdefghijklmnopqrstuvwxyz0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ_' ASCII
+cmdsub_bench 104857600 'abcdefghijklmnopqrstuvwxyz0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ_' ASCII
+
+case "${LC_CTYPE-}" in (*[Uu][Tt][Ff]-8|*[Uu][Tt][Ff]8)
+    cmdsub_bench 1048576   'あいうえおかきくけこさしすせそたちつてと0123456789' UTF-8
+    cmdsub_bench 104857600 'あいうえおかきくけこさしすせそたちつてと0123456789' UTF-8
+esac
@@ -91,4 +91,108 @@ __ERR__
 #`
 #`
 
+test_oE 'long output spanning many reads'
+s=0123456789abcdef
+for i in 1 2 3 4 5 6 7 8 9 10 11 12 13; do s=$s$s; done
+x=$(printf '%s\n\n\n' "$s")
+[ "$x" = "$s" ] && echo ${#x}
+x=$(printf '%s\n%s\n' "$s" "$s")
+[ "$x" = "$s
+$s" ] && echo ${#x}
+__IN__
+131072
+262145
+__OUT__
+
+test_oE 'built-ins and functions in command substitution'
+f() { echo "$1"; return 3; }
+a=$(printf '%s\n' bar "$(pwd)" >/dev/null; f foo)
+echo "[$a] $?"
+b=$(echo x; false)
+echo "[$b] $?"
+c=$(echo out; echo err >&2) 2>/dev/null
+echo "[$c]"
+echo still to stdout
+__IN__
+[foo] 3
+[x] 1
+[out]
+still to stdout
+__OUT__
+
+test_oE 'command substitution does not affect shell environment'
+f() { v=changed; echo f; }
+v=orig
+a=$(f) b=$(v=x; echo $v) c=$(exit 5; echo not reached) d=$(cd /; pwd)
+echo "$a $b [$c] $d $v"
+__IN__
+f x [] / orig
+__OUT__
+
+test_oE 'expansion error in command substitution exits only subshell'
+a=$(echo ${u?} not reached) 2>/dev/null
+echo "[$a] $?"
+__IN__
+[] 2
+__OUT__
+
+test_oE 'file contents substitution'
+printf 'foo\nbar\n\n\n' >file
+f=file
+a=$(<file) b=$(< "$f") c=$(0<file )
+printf '[%s]\n' "$a" "$b" "$c"
+__IN__
+[foo
+bar]
+[foo
+bar]
+[foo
+bar]
+__OUT__
+
+test_oE 'file contents substitution from empty file and FIFO'
+: >empty
+a=$(<empty)
+echo "[$a] $?"
+mkfifo fifo
+(echo from fifo >fifo &)
+b=$(<fifo)
+echo "[$b] $?"
+__IN__
+[] 0
+[from fifo] 0
+__OUT__
+
+test_oE 'file contents substitution with expansion in subshell'
+printf 'x\n' >0
+i=0
+a=$(<${i:=file})
+echo "[$a] $i"
+__IN__
+[x] 0
+__OUT__
+
+test_oE 'file contents substitution from missing file'
+a=$(<_no_such_file_) 2>/dev/null
+echo "[$a] $?"
+__IN__
+[] 2
+__OUT__
+
+test_oE 'redirection other than single input is not file contents substitution'
+printf 'foo\n' >file
+a=$(<file >/dev/null) b=$(3<file) c=$(<file; :)
+echo "[$a] [$b] [$c]"
+__IN__
+[] [] []
+__OUT__
+
+test_oE -e 0 'file contents substitution in POSIX mode' --posix
+printf 'foo\n' >file
+a=$(<file)
+echo "[$a]"
+__IN__
+[]
+__OUT__
+
 # vim: set ft=sh ts=8 sts=4 sw=4 noet:
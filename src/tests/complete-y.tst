@@ -23,4 +23,31 @@ __IN__
 complete: the complete built-in can be used during command line completion only
 __ERR__
 
+(
+# The tests below type into an interactive shell through ptinput. They are
+# skipped unless line editing works there: the probe command is completed only
+# if ^A moves the cursor to the beginning of the line.
+printf 'ho ok >lineedit-probe\1ec\nexit\n' |
+TERM=vt100 ../ptinput "$TESTEE" -i +m --norcfile -o emacs >/dev/null 2>&1
+if ! [ -f lineedit-probe ]; then
+    skip="true"
+fi
+
+# The directory's modification time is made old so that the shell trusts the
+# directory index. A file made executable after the directory has been indexed
+# must still be completed as a command name.
+test_oE 'completing command name made executable after indexing'
+mkdir dir
+echo 'echo completed >result' >dir/yashtestcmd
+touch -t 200001010000 dir
+printf 'yashtestc\t\nchmod a+x dir/yashtestcmd\nyashtestc\t\nexit\n' |
+PATH="$PWD/dir:$PATH" TERM=vt100 \
+    ../ptinput "$TESTEE" -i +m --norcfile -o emacs >/dev/null 2>&1
+cat result
+__IN__
+completed
+__OUT__
+
+)
+
 # vim: set ft=sh ts=8 sts=4 sw=4 noet:
@@ -207,4 +207,44 @@ test_O -d -e n 'echoing to closed stream'
 echo >&-
 __IN__
 
+test_o -e 0 'output order with other commands and redirections'
+echo 1
+cat <<\END
+2
+END
+echo 3 >&2
+echo 4
+(echo 5)
+x=$(echo 6; echo 7 >&2)
+echo "$x"
+echo 8
+exec 2>&1
+echo 9 >&2
+echo 10
+__IN__
+1
+2
+4
+5
+6
+8
+9
+10
+__OUT__
+
+test_o 'buffered output is flushed before waiting for input'
+mkfifo fifo
+{ echo 1; echo 2; read x; echo "reply $x"; } <fifo |
+{ read y; read z; echo "answer $y $z"; read z; echo "$z" >&3; } 3>&1 >fifo
+__IN__
+reply answer 1 2
+__OUT__
+
+test_O -d -e n 'echoing to stream closed after successful output'
+exec >/dev/null
+echo 1
+exec >&-
+echo 2
+__IN__
+
 # vim: set ft=sh ts=8 sts=4 sw=4 noet:
@@ -53,6 +53,20 @@ __IN__
 A
 __OUT__
 
+test_oE 'inherited variable that is not imported is kept exported'
+env BIN="$(printf '\377\376')" LC_ALL=C "$TESTEE" -c 'export FOO=1; env' |
+grep -ac '^BIN='
+__IN__
+1
+__OUT__
+
+test_oE 'inherited variable that is not imported can be overridden'
+env BIN="$(printf '\377\376')" LC_ALL=C "$TESTEE" -c 'export BIN=X; env' |
+grep -a '^BIN='
+__IN__
+BIN=X
+__OUT__
+
 test_O -d -e 1 'assigning to ill-named variable'
 export =A
 __IN__
@@ -0,0 +1,60 @@
+# glob-bench.sh: benchmark of pathname expansion
+# vim: set ts=8 sts=4 sw=4 noet:
+
+# Creates a directory tree
+# $1 = pathname of the root directory
+# $2 = depth of the tree
+# $3 = number of subdirectories in each directory
+# $4 = number of regular files in each directory
+make_tree() {
+    mkdir "$1"
+    (
+    cd -- "$1"
+    i=0
+    while [ $i -lt "$4" ]; do
+	: >"file$i.c"
+	: >"file$i.h"
+	i=$((i+1))
+    done
+    if [ "$2" -gt 0 ]; then
+	i=0
+	while [ $i -lt "$3" ]; do
+	    make_tree "dir$i" $(($2-1)) "$3" "$4"
+	    i=$((i+1))
+	done
+    fi
+    )
+}
+
+# Expands recursive patterns in a directory tree
+# $1 = depth of the tree
+# $2 = number of subdirectories in each directory
+# $3 = number of regular files in each directory
+recursive_glob_bench() {
+    make_tree tree "$@"
+    set -o extendedglob
+    bench "**/*.c in tree of depth $1" - eval 'set -- tree/**/*.c'
+    bench "**/ in tree of depth $1" - eval 'set -- tree/**/'
+    set -o markdirs
+    bench "markdirs **/* in tree of depth $1" - eval 'set -- tree/**/*'
+    set +o markdirs +o extendedglob
+    rm -fr tree
+}
+
+# Expands a pattern that matches many files, which are sorted
+# $1 = number of files
+sort_glob_bench() {
+    mkdir many
+    i=0
+    while [ $i -lt "$1" ]; do
+	: >"many/file$((i * 7919 % $1))"
+	i=$((i+1))
+    done
+    bench "sorting $1 matches" - eval 'set -- many/*'
+    rm -fr many
+}
+
+sort_glob_bench 50000
+
+recursive_glob_bench 3 8 20
+recursive_glob_bench 5 4 20
@@ -63,6 +63,24 @@ __IN__
 Running c/command1
 __OUT__
 
+export TEST_NO="$LINENO"
+test_oE 'command added to directory in $PATH after search'
+mkdir a b
+PATH=$PWD/a:$PWD/b:$PATH
+command1 2>/dev/null
+echo --- $?
+make_command b/command1
+command1
+echo ---
+make_command a/command2
+command2
+__IN__
+--- 127
+Running b/command1
+---
+Running a/command2
+__OUT__
+
 export TEST_NO="$LINENO"
 test_oE 'removing specific remembered command path'
 mkdir a b c
@@ -690,10 +690,11 @@ __IN__
 read: read a line from the standard input
 
 Syntax:
-	read [-Aer] [-P|-p] variable...
+	read [-Aber] [-P|-p] variable...
 
 Options:
 	-A       --array
+	-b       --buffered
 	-e       --line-editing
 	-P       --ps1
 	-p ...   --prompt=...
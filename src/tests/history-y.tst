@@ -458,6 +458,26 @@ __OUT__
 
 )
 
+(
+export histfile=histfile$LINENO histsize=100
+(
+umask 077
+printf '%s\n' '#$# yash history v0 r0' \
+    '1:FFFFFFFFFFFFFFFFFFFFFFFF echo foo 1' '2:5F000000 echo foo 2' \
+    >"$histfile"
+)
+
+test_oE -e 0 'entry with invalid time is read from history file' \
+    -i +m --rcfile="rcfile1"
+history
+__IN__
+1	echo foo 1
+2	echo foo 2
+3	history
+__OUT__
+
+)
+
 test_Oe -e 2 'too many operands'
 history 1 2
 __IN__
@@ -435,6 +435,28 @@ __IN__
 [x][123/456/789][123/456/789]
 __OUT__
 
+test_oE '${a/b/c} with bracket expressions and question marks'
+a='a1b22c333'
+bracket ${a/[0-9]?/x} ${a//[[:digit:]]/x} ${a//[!0-9]/} ${a/#?[[:digit:]]/x}
+bracket ${a/%[[:digit:]]?/x} ${a//[]b-]/x} ${a/[b-c]*[a-c]/x} ${a//[[.2.]]/x}
+bracket ${a#*[0-9]} ${a##*[0-9]?} ${a%[0-9]*} ${a%%[0-9]*}
+__IN__
+[ax22c333][axbxxcxxx][122333][xb22c333]
+[a1b22c3x][a1x22c333][a1x333][a1bxxc333]
+[b22c333][a1b22c33][a]
+__OUT__
+
+test_oE 'long patterns with bracket expressions'
+p=$(head -c 1000000 /dev/zero | tr '\0' a)
+a=b${p}c
+case $a in ([ab]${p}c) echo match; esac
+a=x
+bracket "${a#[ab]$p}" "${a%[ab]$p}"
+__IN__
+match
+[x][x]
+__OUT__
+
 test_oE 'scalar parameter index'
 a='1-2-3'
 bracket @ "${a[@]}"
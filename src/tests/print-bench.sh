@@ -0,0 +1,39 @@
+# print-bench.sh: benchmark of the echo and printf built-ins
+# vim: set ts=8 sts=4 sw=4 noet:
+
+# Prints short lines one by one in a loop to a file
+# $1 = number of lines
+print_bench() {
+    numbers="$(awk -v n="$1" 'BEGIN { for (i = 1; i <= n; i++) print i }')"
+    bench "echo of $1 lines" - eval '
+    for i in $numbers; do
+	echo "line $i"
+    done >|output'
+    bench "printf of $1 lines" - eval '
+    for i in $numbers; do
+	printf "line %d\n" "$i"
+    done >|output'
+    unset numbers i
+    rm -f output
+}
+
+# Formats a line of several conversions one by one in a loop to a file
+# $1 = number of lines
+printf_format_bench() {
+    numbers="$(awk -v n="$1" 'BEGIN { for (i = 1; i <= n; i++) print i }')"
+    bench "printf of $1 lines with %s, %d, and %x" - eval '
+    for i in $numbers; do
+	printf "%s\t%d\t%x\n" "line" "$i" "$i"
+    done >|output'
+    bench "printf of $1 lines with %5d and %-8s" - eval '
+    for i in $numbers; do
+	printf "%5d %-8s|\n" "$i" "line"
+    done >|output'
+    unset numbers i
+    rm -f output
+}
+
+print_bench 10000
+print_bench 1000000
+printf_format_bench 10000
+printf_format_bench 1000000
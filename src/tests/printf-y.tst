@@ -513,6 +513,19 @@ __IN__
 1
 __OUT__
 
+test_oE 'reusing formats repeatedly'
+for i in 1 2 3; do
+    for f in a b c d e f g h i j; do
+	printf "$f%d%s%x|" "$i" "$f" "$((i+9))"
+    done
+    printf '%s\n' ''
+done
+__IN__
+a1aa|b1ba|c1ca|d1da|e1ea|f1fa|g1ga|h1ha|i1ia|j1ja|
+a2ab|b2bb|c2cb|d2db|e2eb|f2fb|g2gb|h2hb|i2ib|j2jb|
+a3ac|b3bc|c3cc|d3dc|e3ec|f3fc|g3gc|h3hc|i3ic|j3jc|
+__OUT__
+
 test_Oe -e n 'invalid option'
 printf --no-such-option ''
 __IN__
@@ -0,0 +1,42 @@
+# read-bench.sh: benchmark of the read built-in
+# vim: set ts=8 sts=4 sw=4 noet:
+
+# Reads lines one by one from a pipe in a loop
+# $1 = number of lines
+read_pipe_bench() {
+    awk -v n="$1" 'BEGIN { for (i = 1; i <= n; i++) print "line", i }' >input
+    bench "read of $1 lines from pipe" - eval '
+    cat input | while read -r line; do
+	:
+    done'
+    bench "read -b of $1 lines from pipe" - eval '
+    cat input | while read -br line; do
+	:
+    done'
+    bench "read -b of $1 lines from file" - eval '
+    while read -br line; do
+	:
+    done <input'
+    rm -f input
+}
+
+# Loads lines from a file into an array
+# $1 = number of lines
+read_array_bench() {
+    awk -v n="$1" 'BEGIN { for (i = 1; i <= n; i++) print "line", i }' >input
+    bench "array -i of $1 lines read by read" - eval '
+    a=()
+    while read -r line; do
+	array -i a -1 "$line"
+    done <input'
+    bench "readarray of $1 lines" - eval '
+    readarray -t a <input'
+    unset a line
+    rm -f input
+}
+
+read_pipe_bench 10000
+read_pipe_bench 100000
+read_array_bench 10000
+read_array_bench 100000
+read_array_bench 1000000
@@ -192,6 +192,59 @@ __IN__
 [A] [B:C:D]
 __OUT__
 
+test_oE 'buffered reading from pipe'
+printf '%s\n' 1 2 3 '4 5' 6 | {
+read -b a
+read b
+read --buffered c
+read -b d e
+echo "$a $b $c $d $e"
+read -b f
+echo "[$f] $?"
+read -b g
+echo "[$g] $?"
+}
+__IN__
+1 2 3 4 5
+[6] 0
+[] 1
+__OUT__
+
+test_oE 'buffered reading from pipe with redirection in between'
+printf '%s\n' 1 2 3 | {
+read -b a
+read -b b <<\END
+X
+Y
+END
+read -b c
+echo $a $b $c
+}
+__IN__
+1 X 2
+__OUT__
+
+test_oE 'buffered input from pipe is not inherited by subshell'
+printf '%s\n' 1 2 3 | {
+read -b a
+(read b; echo "[$b] $?")
+read -b c
+echo $a $c
+}
+__IN__
+[] 1
+1 2
+__OUT__
+
+test_oE 'buffered reading from regular file followed by external command'
+printf '%s\n' 1 2 3 4 >file
+{ read -b a; read -b b; cat; echo $a $b; } <file
+__IN__
+3
+4
+1 2
+__OUT__
+
 test_O -d -e 1 'reading from closed stream'
 read foo <&-
 __IN__
@@ -0,0 +1,163 @@
+# readarray-y.tst: yash-specific test of the readarray built-in
+
+test_oE 'reading lines with newlines'
+printf 'a b\n\nc\n' | {
+readarray x
+echo $?
+typeset -p x
+}
+__IN__
+0
+x=('a b
+' '
+' 'c
+')
+typeset x
+__OUT__
+
+test_oE 'reading lines without newlines'
+printf 'a b\n\nc\n' | {
+readarray -t x
+echo $?
+typeset -p x
+}
+__IN__
+0
+x=('a b' '' c)
+typeset x
+__OUT__
+
+test_oE 'last line without newline'
+printf '1\n2' | {
+readarray --trim x
+typeset -p x
+}
+__IN__
+x=(1 2)
+typeset x
+__OUT__
+
+test_oE 'empty input'
+readarray x </dev/null
+echo $?
+typeset -p x
+__IN__
+0
+x=()
+typeset x
+__OUT__
+
+test_oE 'custom delimiter'
+printf 'a:b\n::c' | {
+readarray -d : x
+readarray --delimiter=: -t y <<\END
+a:b::c
+END
+typeset -p x y
+}
+__IN__
+x=('a:' 'b
+:' ':' c)
+typeset x
+y=(a b '' 'c
+')
+typeset y
+__OUT__
+
+test_oE 'null character as delimiter'
+printf 'a\0b c\0' | {
+readarray -t -d '' x
+typeset -p x
+}
+__IN__
+x=(a 'b c')
+typeset x
+__OUT__
+
+test_oE 'multibyte characters'
+printf '\343\201\202\n\343\201\204\n' | {
+readarray -t x
+echo "${x[#]}" "${x[1]}${x[2]}"
+}
+__IN__
+2 あい
+__OUT__
+
+test_oE 'many lines'
+i=0
+while [ $i -lt 3000 ]; do
+    echo $i
+    i=$((i+1))
+done | {
+readarray -t x
+echo "${x[#]}" "${x[1]}" "${x[1234]}" "${x[-1]}"
+}
+__IN__
+3000 0 1233 2999
+__OUT__
+
+test_oE 'lines read ahead by read are used'
+printf '1\n2\n3\n' | {
+read -b a
+readarray -t x
+echo "$a" "$x"
+}
+__IN__
+1 2 3
+__OUT__
+
+test_oE 'appending to array read'
+printf '1\n2\n' | {
+readarray -t x
+x+=(3)
+array -i x 0 0
+echo "$x"
+}
+__IN__
+0 1 2 3
+__OUT__
+
+test_Oe -e 2 'multi-character delimiter'
+readarray -d ab x </dev/null
+__IN__
+readarray: the delimiter must be a single character
+__ERR__
+
+test_Oe -e 2 'missing operand'
+readarray
+__IN__
+readarray: this command requires an operand
+__ERR__
+
+test_Oe -e 2 'too many operands'
+readarray x y
+__IN__
+readarray: too many operands are specified
+__ERR__
+
+test_Oe -e 1 'invalid array name'
+readarray a=b </dev/null
+__IN__
+readarray: `a=b' is not a valid array name
+__ERR__
+#'
+#`
+
+test_O -d -e 1 'read-only array'
+readonly x=1
+readarray x </dev/null
+__IN__
+
+test_O -d -e 1 'reading from closed stream'
+readarray x <&-
+__IN__
+
+test_Oe -e 2 'invalid option'
+readarray --no-such-option x
+__IN__
+readarray: `--no-such-option' is not a valid option
+__ERR__
+#'
+#`
+
+# vim: set ft=sh ts=8 sts=4 sw=4 noet:
@@ -0,0 +1,101 @@
+# run-bench.sh: runs a set of benchmarks
+
+# This script must be run by the shell to be measured. The operands are the
+# pathnames to the benchmark files (*-bench.sh), which are sourced one by one
+# in a subshell. A benchmark file measures commands by calling the "bench"
+# function defined below. The results are printed to the standard output.
+# Benchmarks are not tests: they do not fail when the shell is slow.
+
+set -Ceu
+umask u+rwx
+
+if ! [ "${YASH_VERSION-}" ]; then
+    printf '%s: must be run with yash\n' "$0" >&2
+    exit 64 # sysexits.h EX_USAGE
+fi
+
+export LC_CTYPE="${LC_ALL-${LC_CTYPE-${LANG-C}}}"
+export LANG=C
+unset -v LC_ALL IFS ENV
+
+##### Prepare temporary directory
+
+work_dir="$(pwd)/bench.$$"
+
+rm_work_dir() {
+    rm -fr "$work_dir"
+}
+
+trap rm_work_dir EXIT
+trap 'rm_work_dir; trap - INT;  kill -INT  $$' INT
+trap 'rm_work_dir; trap - TERM; kill -TERM $$' TERM
+
+mkdir "$work_dir"
+
+##### Utilities for benchmark files
+
+# $1 = variable name
+# Assigns the CPU time (in seconds) consumed so far by the current shell process
+# and its waited-for children to the variable. (This function must not be
+# called in a command substitution, which would measure the subshell.)
+cputime() {
+    times >|"$work_dir/times"
+    {
+	read -r _cpu_su _cpu_ss
+	read -r _cpu_cu _cpu_cs
+    } <"$work_dir/times"
+    _cpu_sum=0
+    for _cpu_t in "$_cpu_su" "$_cpu_ss" "$_cpu_cu" "$_cpu_cs"; do
+	_cpu_min="${_cpu_t%%m*}" _cpu_sec="${_cpu_t#*m}"
+	_cpu_sum="$((_cpu_sum + _cpu_min * 60 + ${_cpu_sec%s}))"
+    done
+    eval "$1=\$_cpu_sum"
+}
+
+# $1 = name of the measurement
+# $2 = amount of data processed in bytes, or "-" if not applicable
+# $3... = command to measure
+# Runs the command once in the current shell environment and prints the CPU
+# time it consumed. If the amount of data is given, the throughput is printed
+# as well.
+bench() {
+    _bench_name="$1" _bench_size="$2"
+    shift 2
+    cputime _bench_start
+    "$@"
+    cputime _bench_end
+    _bench_time="$((_bench_end - _bench_start))"
+    if [ "$_bench_size" = - ]; then
+	printf '%-40s %10.3fs\n' "$_bench_name" "$_bench_time"
+    elif [ "$((_bench_time > 0))" -ne 0 ]; then
+	printf '%-40s %10.3fs %10.1f MB/s\n' "$_bench_name" "$_bench_time" \
+	    "$((_bench_size / 1048576.0 / _bench_time))"
+    else
+	printf '%-40s %10.3fs %10s MB/s\n' "$_bench_name" "$_bench_time" '-'
+    fi
+}
+
+# $1 = pathname of the file to create
+# $2 = size of the file in bytes
+# $3 = line to repeat (default: 63 ASCII characters)
+# Creates a file filled with copies of the line. The size is rounded down to a
+# multiple of the line size (including the newline).
+make_data_file() {
+    LC_ALL=C awk -v size="$2" -v line="${3-abcdefghijklmnopqrstuvwxyz0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ_}" '
+    BEGIN {
+	for (n = int(size / (length(line) + 1)); n > 0; n--)
+	    print line
+    }' >|"$1"
+}
+
+##### Run benchmarks
+
+for bench_file do
+    printf '=== %s\n' "$bench_file"
+    (
+    cd "$work_dir"
+    . "$OLDPWD/$bench_file"
+    )
+done
+
+# vim: set ts=8 sts=4 sw=4 noet:
@@ -33,6 +33,81 @@ __IN__
 1
 __OUT__
 
+test_oE 'assignment referring to assigned variable'
+HOME=/home a=1
+a=$a-2
+a="$a-3"
+a=${a}4
+a=$a:~
+b=$a~
+echo "$a" "$b"
+n=1
+n=$n$((n=2))
+echo "$n"
+__IN__
+1-2-34:/home 1-2-34:/home~
+12
+__OUT__
+
+test_oE 'appending assignment to scalar'
+a=1
+a+=2 b+=3
+a+="$a"
+echo "$a" "$b"
+a+=x sh -c 'echo "$a"'
+echo "$a"
+__IN__
+1212 3
+1212x
+1212
+__OUT__
+
+test_oE 'appending assignment to array'
+a=(1 2)
+a+=(3 '4 5')
+a+=6
+b=x
+b+=(y)
+bracket "$a" "$b"
+__IN__
+[1][2][3][4 5][6][x][y]
+__OUT__
+
+test_O -d -e 2 'appending assignment to read-only variable'
+readonly a=1
+a+=2
+__IN__
+
+test_oE 'external command followed by another command'
+echo 'echo script "$@"' >noshebang
+chmod a+x noshebang
+./noshebang 1 2
+echo $?
+sh -c 'exit 3'
+echo $?
+__IN__
+script 1 2
+0
+3
+__OUT__
+
+test_o -d 'executing directory'
+mkdir dir
+./dir
+echo $?
+__IN__
+126
+__OUT__
+
+test_oE 'ignored signal is inherited by external command'
+trap '' USR1
+sh -c 'kill -s USR1 $$; echo ignored'
+echo $?
+__IN__
+ignored
+0
+__OUT__
+
 test_o -d 'COMMAND_NOT_FOUND_HANDLER is run when command was not found'
 COMMAND_NOT_FOUND_HANDLER=('echo not found' 'echo handled')
 ./_no_such_command_
@@ -110,6 +185,10 @@ __OUT__
 (
 posix=true
 
+test_O -d -e 127 'appending assignment in POSIXly-correct mode'
+a+=1
+__IN__
+
 test_O -e 127 'not-found handler is not run in POSIXly-correct mode'
 COMMAND_NOT_FOUND_HANDLER='echo not reached'
 ./_no_such_command_
@@ -74,4 +74,29 @@ __ERR__
 #'
 #`
 
+test_oE 'waiting for many jobs'
+i=0
+while [ "$i" -lt 10000 ]; do
+    exit "$((i % 100))" &
+    case $i in
+	(4242) p1=$! ;;
+	(9999) p2=$! ;;
+    esac
+    i=$((i+1))
+done
+wait "$p1"
+echo $?
+wait "$p2"
+echo $?
+wait
+echo $?
+wait "$p1"
+echo $?
+__IN__
+42
+99
+0
+127
+__OUT__
+
 # vim: set ft=sh ts=8 sts=4 sw=4 noet:
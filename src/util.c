@@ -25,6 +25,7 @@
 # include <libintl.h>
 #endif
 #include <limits.h>
+#include <locale.h>
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -34,6 +35,8 @@
 #include "exec.h"
 #include "option.h"
 #include "plist.h"
+#include "redir.h"
+#include "strbuf.h"
 
 
 /********** Memory Utilities **********/
@@ -221,6 +224,112 @@ void *copyaswcs(const void *p)
     return xwcsdup(p);
 }
 
+/* Checks if the current LC_COLLATE locale is the POSIX locale. */
+bool is_posix_collation(void)
+{
+    const char *locale = setlocale(LC_COLLATE, NULL);
+    return locale != NULL &&
+	(strcmp(locale, "C") == 0 || strcmp(locale, "POSIX") == 0);
+}
+
+
+/********** Sorting Utilities **********/
+
+/* A collation key paired with the index of the element it was made from.
+ * While the keys are being made, `key.offset' is the offset of the key in the
+ * buffer, which may be reallocated. */
+struct collkey_T {
+    union {
+	const wchar_t *pointer;
+	size_t offset;
+    } key;
+    size_t index;
+};
+
+static int compare_collkeys(const void *k1, const void *k2)
+    __attribute__((nonnull));
+
+/* The arguments to `sort_by_collation' used in `compare_collkeys'. */
+static const char *collsort_base;
+static size_t collsort_size;
+static int (*collsort_precmp)(const void *elem1, const void *elem2);
+
+/* Sorts the array of `count' elements of `size' bytes starting at `base' in
+ * the collation order of the strings returned by `keyof' for the elements.
+ * If `precmp' is non-NULL, it is called first to compare two elements and the
+ * strings are compared only if it returns zero.
+ * The result is the same as that of `qsort' with a comparison function that
+ * calls `wcscoll', but `wcscoll' is not called for each comparison: the
+ * collation key of each string is computed by `wcsxfrm' just once. In the POSIX
+ * locale, the strings themselves are used as the keys.
+ * Elements that compare equal retain their original order. */
+void sort_by_collation(void *base, size_t count, size_t size,
+	const wchar_t *keyof(const void *elem),
+	int precmp(const void *elem1, const void *elem2))
+{
+    if (count < 2)
+	return;
+
+    char *elems = base;
+    struct collkey_T *keys = xmallocn(count, sizeof *keys);
+    xwcsbuf_T buf;
+    wb_init(&buf);
+
+    if (is_posix_collation()) {
+	for (size_t i = 0; i < count; i++) {
+	    keys[i].key.pointer = keyof(&elems[i * size]);
+	    keys[i].index = i;
+	}
+    } else {
+	/* All the keys are stored in the single buffer, separated by null
+	 * characters. */
+	wb_ensuremax(&buf, mul(count, 8));
+	for (size_t i = 0; i < count; i++) {
+	    const wchar_t *s = keyof(&elems[i * size]);
+	    size_t len;
+	    while ((len = wcsxfrm(&buf.contents[buf.length], s,
+			    buf.maxlength - buf.length))
+		    >= buf.maxlength - buf.length)
+		wb_ensuremax(&buf, add(buf.length, add(len, 1)));
+	    keys[i].key.offset = buf.length;
+	    keys[i].index = i;
+	    buf.length += len + 1;
+	}
+	for (size_t i = 0; i < count; i++)
+	    keys[i].key.pointer = &buf.contents[keys[i].key.offset];
+    }
+
+    collsort_base = elems;
+    collsort_size = size;
+    collsort_precmp = precmp;
+    qsort(keys, count, sizeof *keys, compare_collkeys);
+
+    char *sorted = xmallocn(count, size);
+    for (size_t i = 0; i < count; i++)
+	memcpy(&sorted[i * size], &elems[keys[i].index * size], size);
+    memcpy(elems, sorted, count * size);
+    free(sorted);
+    free(keys);
+    wb_destroy(&buf);
+}
+
+int compare_collkeys(const void *k1, const void *k2)
+{
+    const struct collkey_T *ck1 = k1, *ck2 = k2;
+
+    if (collsort_precmp != NULL) {
+	int cmp = collsort_precmp(&collsort_base[ck1->index * collsort_size],
+		&collsort_base[ck2->index * collsort_size]);
+	if (cmp != 0)
+	    return cmp;
+    }
+
+    int cmp = wcscmp(ck1->key.pointer, ck2->key.pointer);
+    if (cmp != 0)
+	return cmp;
+    return (ck1->index > ck2->index) - (ck1->index < ck2->index);
+}
+
 
 /********** Error Utilities **********/
 
@@ -245,6 +354,7 @@ unsigned yash_error_message_count = 0;
 void xerror(int errno_, const char *restrict format, ...)
 {
     yash_error_message_count++;
+    flush_stdout();
     fprintf(stderr, "%ls: ",
 	    current_builtin_name != NULL
 	    ? current_builtin_name
@@ -275,6 +385,7 @@ bool xprintf(const char *restrict format, ...)
     va_list ap;
     int result;
 
+    flush_stdout();
     va_start(ap, format);
     result = vprintf(format, ap);
     va_end(ap);
@@ -197,6 +197,7 @@ extern wchar_t *matchwcsprefix(const wchar_t *s, const wchar_t *prefix)
     __attribute__((pure,nonnull));
 extern void *copyaswcs(const void *p)
     __attribute__((malloc,warn_unused_result,nonnull));
+extern _Bool is_posix_collation(void);
 
 #if HAVE_STRNLEN
 # ifndef strnlen
@@ -257,6 +258,14 @@ wchar_t *xwcsdup(const wchar_t *s)
     ((union { char c; unsigned char uc; }) { .uc = (unsigned char) (value), }.c)
 
 
+/********** Sorting Utilities **********/
+
+extern void sort_by_collation(void *base, size_t count, size_t size,
+	const wchar_t *keyof(const void *elem),
+	int precmp(const void *elem1, const void *elem2))
+    __attribute__((nonnull(4)));
+
+
 /********** Error Utilities **********/
 
 extern const wchar_t *yash_program_invocation_name;
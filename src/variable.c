@@ -46,6 +46,7 @@
 #include "parser.h"
 #include "path.h"
 #include "plist.h"
+#include "redir.h"
 #include "sig.h"
 #include "strbuf.h"
 #include "util.h"
@@ -102,23 +103,42 @@ typedef enum vartype_T {
 typedef struct variable_T {
     vartype_T v_type;
     union {
-	wchar_t *value;
+	struct {
+	    wchar_t *value;
+	    size_t length, capacity;
+	} scalar;
 	struct {
 	    void **vals;
-	    size_t valc;
+	    size_t valc, head, capacity;
 	} array;
     } v_contents;
     void (*v_getter)(struct variable_T *var);
 } variable_T;
-#define v_value v_contents.value
-#define v_vals  v_contents.array.vals
-#define v_valc  v_contents.array.valc
+#define v_value    v_contents.scalar.value
+#define v_length   v_contents.scalar.length
+#define v_capacity v_contents.scalar.capacity
+#define v_vals     v_contents.array.vals
+#define v_valc     v_contents.array.valc
+#define v_valhead  v_contents.array.head
+#define v_valcap   v_contents.array.capacity
 /* `v_vals' is a NULL-terminated array of pointers to wide strings.
  * `v_valc' is, of course, the number of elements in `v_vals'.
  * `v_value', `v_vals' and the elements of `v_vals' are `free'able.
  * `v_value' is NULL if the variable is declared but not yet assigned.
  * `v_vals' is always non-NULL, but it may contain no elements.
- * `v_getter' is the setter function, which is reset to NULL on reassignment.*/
+ * `v_getter' is the setter function, which is reset to NULL on reassignment.
+ * `v_capacity' is the number of characters (excluding the terminating null
+ * character) that can be stored in the memory allocated for `v_value', and
+ * `v_length' is the length of `v_value'. They are valid only if `v_capacity'
+ * is non-zero. `v_capacity' must be reset to zero whenever `v_value' is
+ * replaced. Only `append_to_variable' allocates spare capacity.
+ * The elements of `v_vals' are stored in the middle of a memory block so that
+ * elements can be added or removed at either end without moving the others:
+ * `v_valhead' is the number of unused pointers that precede `v_vals' in the
+ * block and `v_valcap' is the number of elements (excluding the terminating
+ * NULL) that can be stored in the block from `v_vals'. The block starts at
+ * `v_vals - v_valhead', so `v_vals' must not be passed to `free' directly.
+ * `v_valhead' and `v_valcap' must be updated whenever `v_vals' is replaced. */
 
 /* type of shell functions (defined later) */
 typedef struct function_T function_T;
@@ -126,6 +146,13 @@ typedef struct function_T function_T;
 
 static void varvaluefree(variable_T *v)
     __attribute__((nonnull));
+static void reserve_array_room(variable_T *var, size_t front, size_t back)
+    __attribute__((nonnull));
+static void insert_array_range(variable_T *var,
+	size_t index, size_t count, void *const *values)
+    __attribute__((nonnull));
+static void delete_array_range(variable_T *var, size_t index, size_t count)
+    __attribute__((nonnull));
 static void varfree(variable_T *v);
 static void varkvfree(kvpair_T kv);
 static void varkvfree_reexport(kvpair_T kv);
@@ -138,6 +165,14 @@ static variable_T *search_array_and_check_if_changeable(const wchar_t *name)
     __attribute__((pure,nonnull));
 static void update_environment(const wchar_t *name)
     __attribute__((nonnull));
+static bool is_environment_variable_name(const wchar_t *name)
+    __attribute__((nonnull,pure));
+static void forget_undecodable_environ(const wchar_t *name)
+    __attribute__((nonnull));
+static bool is_used_by_shell_process(const wchar_t *name)
+    __attribute__((nonnull,pure));
+static char **build_environ(void)
+    __attribute__((malloc,warn_unused_result));
 static void reset_locale(const wchar_t *name)
     __attribute__((nonnull));
 static void reset_locale_category(const wchar_t *name, int category)
@@ -150,9 +185,21 @@ static variable_T *new_temporary(const wchar_t *name)
     __attribute__((nonnull));
 static variable_T *new_variable(const wchar_t *name, scope_T scope)
     __attribute__((nonnull));
-static void xtrace_variable(const wchar_t *name, const wchar_t *value)
+static variable_T *search_appendable_variable(const wchar_t *name)
+    __attribute__((nonnull));
+static bool append_to_variable(
+	const wchar_t *name, wchar_t *value, scope_T scope, bool export)
+    __attribute__((nonnull));
+static bool append_to_array(const wchar_t *name, size_t count, void **values,
+	scope_T scope, bool export)
+    __attribute__((nonnull));
+static bool skip_self_reference(const wchar_t *name,
+	const wordunit_T **wordp, wordunit_T *quote)
     __attribute__((nonnull));
-static void xtrace_array(const wchar_t *name, void *const *values)
+static void xtrace_variable(
+	const wchar_t *name, bool append, const wchar_t *value)
+    __attribute__((nonnull));
+static void xtrace_array(const wchar_t *name, bool append, void *const *values)
     __attribute__((nonnull));
 static size_t make_array_of_all_variables(bool global, kvpair_T **resultp)
     __attribute__((nonnull));
@@ -196,6 +243,11 @@ static bool random_active;
 /* hashtable from function names (wchar_t *) to functions (function_T *). */
 static hashtable_T functions;
 
+/* list of the strings in the original `environ' that could not be converted
+ * to wide strings (char *). These are not imported as variables but are
+ * passed to external commands as they are. */
+static plist_T undecodable_environ;
+
 
 /* Frees the value of the specified variable (but not the variable itself). */
 /* This function does not change the value of `*v'. */
@@ -206,11 +258,86 @@ void varvaluefree(variable_T *v)
 	    free(v->v_value);
 	    break;
 	case VF_ARRAY:
-	    plfree(v->v_vals, free);
+	    for (size_t i = 0; i < v->v_valc; i++)
+		free(v->v_vals[i]);
+	    free(v->v_vals - v->v_valhead);
 	    break;
     }
 }
 
+/* Makes sure that the memory block of array variable `var' has room for at
+ * least `front' more elements before and `back' more elements after the
+ * current elements. When the block is reallocated, extra room as large as the
+ * current number of elements is allocated on the side(s) that need more room
+ * so that repeated addition at either end takes amortized constant time. */
+void reserve_array_room(variable_T *var, size_t front, size_t back)
+{
+    size_t count = var->v_valc;
+    size_t head = var->v_valhead, tail = var->v_valcap - count;
+    if (front <= head && back <= tail)
+	return;
+
+    size_t newhead =
+	(front > head) ? add(front, count) : (head < count) ? head : count;
+    size_t newtail =
+	(back > tail) ? add(back, count) : (tail < count) ? tail : count;
+    void **block =
+	xmalloce(add(newhead, count), add(newtail, 1), sizeof *block);
+    memcpy(&block[newhead], var->v_vals, (count + 1) * sizeof *block);
+    free(var->v_vals - head);
+    var->v_vals = &block[newhead];
+    var->v_valhead = newhead;
+    var->v_valcap = count + newtail;
+}
+
+/* Inserts `count' elements into array variable `var' before the element at
+ * `index', which must not be greater than `var->v_valc'. The pointers in
+ * `values' are stored in the array as they are. The existing elements are
+ * moved toward whichever end of the array is nearer, so adding elements at
+ * either end does not move any other element. */
+void insert_array_range(variable_T *var,
+	size_t index, size_t count, void *const *values)
+{
+    assert(index <= var->v_valc);
+    if (index < var->v_valc - index) {
+	reserve_array_room(var, count, 0);
+	var->v_vals -= count;
+	var->v_valhead -= count;
+	var->v_valcap += count;
+	memmove(var->v_vals, &var->v_vals[count], index * sizeof *var->v_vals);
+    } else {
+	reserve_array_room(var, 0, count);
+	memmove(&var->v_vals[index + count], &var->v_vals[index],
+		(var->v_valc - index + 1) * sizeof *var->v_vals);
+    }
+    memcpy(&var->v_vals[index], values, count * sizeof *values);
+    var->v_valc += count;
+}
+
+/* Removes and frees `count' elements of array variable `var' starting at
+ * `index'. The remaining elements on the shorter side of the removed range are
+ * moved to fill the gap, so removing elements at either end takes time
+ * independent of the array size. */
+void delete_array_range(variable_T *var, size_t index, size_t count)
+{
+    assert(index <= var->v_valc);
+    assert(count <= var->v_valc - index);
+    for (size_t i = 0; i < count; i++)
+	free(var->v_vals[index + i]);
+
+    size_t after = var->v_valc - index - count;
+    if (index < after) {
+	memmove(&var->v_vals[count], var->v_vals, index * sizeof *var->v_vals);
+	var->v_vals += count;
+	var->v_valhead += count;
+	var->v_valcap -= count;
+    } else {
+	memmove(&var->v_vals[index], &var->v_vals[index + count],
+		(after + 1) * sizeof *var->v_vals);
+    }
+    var->v_valc -= count;
+}
+
 /* Frees the specified variable. */
 void varfree(variable_T *v)
 {
@@ -256,15 +383,19 @@ void init_environment(void)
     ht_init(&functions, hashwcs, htwcscmp);
 
     /* add all the existing environment variables to the variable environment */
+    pl_init(&undecodable_environ);
     for (char **e = environ; *e != NULL; e++) {
 	wchar_t *we = malloc_mbstowcs(*e);
-	if (we == NULL)
+	if (we == NULL) {
+	    pl_add(&undecodable_environ, *e);
 	    continue;
+	}
 
 	wchar_t *eqp = wcschr(we, L'=');
 	variable_T *v = xmalloc(sizeof *v);
 	v->v_type = VF_SCALAR | VF_EXPORT;
 	v->v_value = (eqp != NULL) ? xwcsdup(&eqp[1]) : NULL;
+	v->v_capacity = 0;
 	v->v_getter = NULL;
 	if (eqp != NULL) {
 	    *eqp = L'\0';
@@ -291,6 +422,7 @@ void init_variables(void)
 	assert(v != NULL);
 	v->v_type = VF_SCALAR | (v->v_type & VF_EXPORT);
 	v->v_value = NULL;
+	v->v_capacity = 0;
 	v->v_getter = lineno_getter;
 	// variable_set(VAR_LINENO, v);
 	// if (v->v_type & VF_EXPORT)
@@ -333,6 +465,7 @@ void init_variables(void)
 	assert(v != NULL);
 	v->v_type = VF_SCALAR;
 	v->v_value = NULL;
+	v->v_capacity = 0;
 	v->v_getter = random_getter;
 	random_active = true;
 	srand((unsigned) time(NULL) ^ (unsigned) shell_pid << 17);
@@ -408,26 +541,136 @@ variable_T *search_array_and_check_if_changeable(const wchar_t *name)
     return array;
 }
 
-/* Update the value in `environ' for the variable with the specified name.
- * `name' must not contain '='. */
+/* True if `environ' may not reflect the current exported variables. */
+static bool environ_outdated = false;
+/* The array last assigned to `environ' by `get_environ', or NULL. */
+static char **built_environ = NULL;
+
+/* Notes that the exported value of the variable with the specified name may
+ * have changed.
+ * `environ' is not rebuilt until it is needed by `get_environ' unless the
+ * variable may affect the C library functions called in the shell process. */
 void update_environment(const wchar_t *name)
 {
+    if (!is_environment_variable_name(name)) {
+	char *value = get_exported_value(name);
+	if (value != NULL) {
+	    char *mname = malloc_wcstombs(name);
+	    xerror(EINVAL, Ngt("failed to set environment variable $%s"),
+		    mname != NULL ? mname : "");
+	    free(mname);
+	    free(value);
+	}
+	return;
+    }
+
+    forget_undecodable_environ(name);
+    environ_outdated = true;
+    if (is_used_by_shell_process(name))
+	get_environ();
+}
+
+/* Removes the string for the specified name from `undecodable_environ', so
+ * that it is not exported any longer after the variable has been changed. */
+void forget_undecodable_environ(const wchar_t *name)
+{
+    if (undecodable_environ.length == 0)
+	return;
+
     char *mname = malloc_wcstombs(name);
     if (mname == NULL)
 	return;
 
-    char *value = get_exported_value(name);
-    if (value == NULL) {
-	if (xunsetenv(mname) < 0)
-	    xerror(errno, Ngt("failed to unset environment variable $%s"),
-		    mname);
-    } else {
-	if (setenv(mname, value, true) < 0)
-	    xerror(errno, Ngt("failed to set environment variable $%s"), mname);
+    size_t namelen = strlen(mname);
+    for (size_t i = 0; i < undecodable_environ.length; ) {
+	const char *e = undecodable_environ.contents[i];
+	if (strncmp(e, mname, namelen) == 0 && e[namelen] == '=')
+	    pl_remove(&undecodable_environ, i, 1);
+	else
+	    i++;
     }
-
     free(mname);
-    free(value);
+}
+
+/* Returns true if the specified name can be that of an environment variable,
+ * that is, it is non-empty and does not contain '='. */
+bool is_environment_variable_name(const wchar_t *name)
+{
+    return name[0] != L'\0' && wcschr(name, L'=') == NULL;
+}
+
+/* Returns true if the environment variable of the specified name may be
+ * consulted by the C library functions called in the shell process itself,
+ * e.g., for message translation, time formatting, and terminal setup. */
+bool is_used_by_shell_process(const wchar_t *name)
+{
+    return wcscmp(name, L VAR_LANG) == 0
+	|| wcsncmp(name, L"LC_", 3) == 0
+	|| wcscmp(name, L"LANGUAGE") == 0
+	|| wcscmp(name, L"LOCPATH") == 0
+	|| wcscmp(name, L VAR_NLSPATH) == 0
+	|| wcscmp(name, L"TZ") == 0
+	|| wcscmp(name, L VAR_TERM) == 0
+	|| wcsncmp(name, L"TERMINFO", 8) == 0
+	|| wcscmp(name, L VAR_LINES) == 0
+	|| wcscmp(name, L VAR_COLUMNS) == 0;
+}
+
+/* Returns `environ' after rebuilding it from the exported variables if any of
+ * them has changed since it was last built.
+ * The returned array must not be modified or freed by the caller. It is valid
+ * until the next call to this function. */
+char **get_environ(void)
+{
+    if (environ_outdated) {
+	char **oldenviron = built_environ;
+	environ = built_environ = build_environ();
+	environ_outdated = false;
+	plfree((void **) oldenviron, free);
+    }
+    return environ;
+}
+
+/* Creates a new array of the "name=value" strings of all exported variables
+ * and the inherited strings in `undecodable_environ'.
+ * The result is a newly-malloced NULL-terminated array of newly-malloced
+ * strings. */
+char **build_environ(void)
+{
+    /* collect the names of all exported variables */
+    hashtable_T names;
+    ht_init(&names, hashwcs, htwcscmp);
+    for (environ_T *env = current_env; env != NULL; env = env->parent) {
+	size_t i = 0;
+	kvpair_T kv;
+	while ((kv = ht_next(&env->contents, &i)).key != NULL)
+	    if (((variable_T *) kv.value)->v_type & VF_EXPORT)
+		ht_set(&names, kv.key, NULL);
+    }
+
+    plist_T list;
+    pl_initwithmax(&list, names.count);
+
+    size_t i = 0;
+    kvpair_T kv;
+    while ((kv = ht_next(&names, &i)).key != NULL) {
+	if (!is_environment_variable_name(kv.key))
+	    continue;
+	char *value = get_exported_value(kv.key);
+	if (value == NULL)
+	    continue;
+	char *name = malloc_wcstombs(kv.key);
+	if (name != NULL)
+	    pl_add(&list, malloc_printf("%s=%s", name, value));
+	free(name);
+	free(value);
+    }
+    ht_destroy(&names);
+
+    for (size_t j = 0; j < undecodable_environ.length; j++)
+	pl_add(&list, xstrdup(undecodable_environ.contents[j]));
+
+    return (char **) pl_toary(&list);
 }
 
 /* Returns the value of variable `name' that should be exported.
@@ -489,6 +732,11 @@ reset_locale_all:
     }
 }
 
+/* Incremented whenever the LC_COLLATE or LC_CTYPE locale is reset.
+ * Compiled patterns and arithmetic expressions that are cached across
+ * executions are discarded when this value changes. */
+unsigned long locale_generation = 0;
+
 /* Resets the locale of the specified category.
  * `name' must be one of the `LC_*' constants except LC_ALL. */
 void reset_locale_category(const wchar_t *name, int category)
@@ -507,6 +755,8 @@ void reset_locale_category(const wchar_t *name, int category)
 	setlocale(category, wlocale);
 	free(wlocale);
     }
+    if (category == LC_COLLATE || category == LC_CTYPE)
+	locale_generation++;
 }
 
 /* Creates a new scalar variable that has no value.
@@ -530,6 +780,7 @@ variable_T *new_global(const wchar_t *name)
     var = xmalloc(sizeof *var);
     var->v_type = VF_SCALAR;
     var->v_value = NULL;
+    var->v_capacity = 0;
     var->v_getter = NULL;
     ht_set(&first_env->contents, xwcsdup(name), var);
     return var;
@@ -552,6 +803,7 @@ variable_T *new_local(const wchar_t *name)
     var = xmalloc(sizeof *var);
     var->v_type = VF_SCALAR;
     var->v_value = NULL;
+    var->v_capacity = 0;
     var->v_getter = NULL;
     ht_set(&env->contents, xwcsdup(name), var);
     return var;
@@ -579,6 +831,7 @@ variable_T *new_temporary(const wchar_t *name)
     var = xmalloc(sizeof *var);
     var->v_type = VF_SCALAR;
     var->v_value = NULL;
+    var->v_capacity = 0;
     var->v_getter = NULL;
     ht_set(&env->contents, xwcsdup(name), var);
     return var;
@@ -633,6 +886,7 @@ bool set_variable(
 	| (var->v_type & (VF_EXPORT | VF_NODELETE))
 	| (export ? VF_EXPORT : 0);
     var->v_value = value;
+    var->v_capacity = 0;
     var->v_getter = NULL;
 
     variable_set(name, var);
@@ -667,6 +921,8 @@ variable_T *set_array(const wchar_t *name, size_t count, void **values,
 	| (export ? VF_EXPORT : 0);
     var->v_vals = values;
     var->v_valc = (count != 0) ? count : plcount(var->v_vals);
+    var->v_valhead = 0;
+    var->v_valcap = var->v_valc;
     var->v_getter = NULL;
 
     variable_set(name, var);
@@ -675,6 +931,122 @@ variable_T *set_array(const wchar_t *name, size_t count, void **values,
     return var;
 }
 
+/* Returns the variable that an assignment in the global scope would modify,
+ * provided that its value can be modified in place. NULL is returned if there
+ * is no such variable, or it is hidden by a temporary variable, read-only, or
+ * has a getter. */
+variable_T *search_appendable_variable(const wchar_t *name)
+{
+    for (environ_T *env = current_env; env != NULL; env = env->parent) {
+	variable_T *var = ht_get(&env->contents, name).value;
+	if (var != NULL) {
+	    if (env->is_temporary || (var->v_type & VF_READONLY)
+		    || var->v_getter != NULL)
+		return NULL;
+	    return var;
+	}
+    }
+    return NULL;
+}
+
+/* Appends `value' to the value of the specified variable.
+ * If the variable is a scalar, `value' is concatenated to its value. If it is
+ * an array, `value' is added as a new element. If it is not set, this function
+ * is equivalent to `set_variable'.
+ * A scalar assigned in the global scope is extended in place, allocating spare
+ * capacity so that repeated appends take amortized constant time per
+ * character.
+ * `value' must be a `free'able string, which is freed in this function.
+ * Returns true iff successful. On error, an error message is printed to the
+ * standard error. */
+bool append_to_variable(
+	const wchar_t *name, wchar_t *value, scope_T scope, bool export)
+{
+    variable_T *var =
+	(scope == SCOPE_GLOBAL) ? search_appendable_variable(name) : NULL;
+    if (var != NULL && (var->v_type & VF_MASK) == VF_SCALAR
+	    && var->v_value != NULL) {
+	size_t valuelen = wcslen(value);
+	if (var->v_capacity == 0)
+	    var->v_length = var->v_capacity = wcslen(var->v_value);
+
+	size_t newlength = add(var->v_length, valuelen);
+	if (newlength > var->v_capacity) {
+	    size_t newcapacity = add(var->v_capacity, var->v_capacity);
+	    if (newcapacity < newlength)
+		newcapacity = newlength;
+	    var->v_value = xrealloce(
+		    var->v_value, newcapacity, 1, sizeof *var->v_value);
+	    var->v_capacity = newcapacity;
+	}
+	wmemcpy(&var->v_value[var->v_length], value, valuelen + 1);
+	var->v_length = newlength;
+	free(value);
+
+	if (export)
+	    var->v_type |= VF_EXPORT;
+	variable_set(name, var);
+	if (var->v_type & VF_EXPORT)
+	    update_environment(name);
+	return true;
+    }
+
+    struct get_variable_T gv = get_variable(name);
+    if (gv.type == GV_ARRAY) {
+	void **values = xmallocn(2, sizeof *values);
+	values[0] = value;
+	values[1] = NULL;
+	return append_to_array(name, 1, values, scope, export);
+    }
+    if (gv.type == GV_SCALAR) {
+	assert(gv.count == 1);
+	wchar_t *newvalue = malloc_wprintf(L"%ls%ls", gv.values[0], value);
+	if (gv.freevalues)
+	    plfree(gv.values, free);
+	free(value);
+	value = newvalue;
+    }
+    return set_variable(name, value, scope, export);
+}
+
+/* Appends `values' to the elements of the specified array.
+ * If the variable is a scalar, a new array is created that contains the value
+ * of the scalar followed by `values'. If it is not set, this function is
+ * equivalent to `set_array'.
+ * `values' is a NULL-terminated array of pointers to `free'able wide strings,
+ * which is used in or freed by this function. `count' is the number of elements
+ * in `values'.
+ * Returns true iff successful. On error, an error message is printed to the
+ * standard error. */
+bool append_to_array(const wchar_t *name, size_t count, void **values,
+	scope_T scope, bool export)
+{
+    variable_T *var =
+	(scope == SCOPE_GLOBAL) ? search_appendable_variable(name) : NULL;
+    if (var != NULL && (var->v_type & VF_MASK) == VF_ARRAY) {
+	insert_array_range(var, var->v_valc, count, values);
+	free(values);
+
+	if (export)
+	    var->v_type |= VF_EXPORT;
+	variable_set(name, var);
+	if (var->v_type & VF_EXPORT)
+	    update_environment(name);
+	return true;
+    }
+
+    struct get_variable_T gv = get_variable(name);
+    if (gv.type == GV_SCALAR || gv.type == GV_ARRAY) {
+	save_get_variable_values(&gv);
+	gv.values = xrealloce(gv.values, gv.count, count, sizeof *gv.values);
+	memcpy(&gv.values[gv.count], values, (count + 1) * sizeof *values);
+	free(values);
+	values = gv.values;
+	count = add(gv.count, count);
+    }
+    return set_array(name, count, values, scope, export) != NULL;
+}
+
 /* Changes the value of the specified array element.
  * `name' must be the name of an existing array.
  * `index' is the index of the element (counted from zero).
@@ -738,25 +1110,42 @@ bool do_assignments(const assign_T *assign, bool temp, bool export)
 	int count;
 	void **values;
 
+	bool append = assign->a_append;
 	switch (assign->a_type) {
-	    case A_SCALAR:
-		value = expand_single_and_unescape(
-			assign->a_scalar, TT_MULTI, true, false);
+	    case A_SCALAR:;
+		const wordunit_T *word = assign->a_scalar;
+		wordunit_T quote;
+		if (!append && !temp && !shopt_xtrace)
+		    append = skip_self_reference(assign->a_name, &word, &quote);
+		value = expand_single_and_unescape(word, TT_MULTI, true, false);
 		if (value == NULL)
 		    return false;
 		if (shopt_xtrace)
-		    xtrace_variable(assign->a_name, value);
-		if (!set_variable(assign->a_name, value, scope, export))
-		    return false;
+		    xtrace_variable(assign->a_name, append, value);
+		if (append) {
+		    if (!append_to_variable(
+				assign->a_name, value, scope, export))
+			return false;
+		} else {
+		    if (!set_variable(assign->a_name, value, scope, export))
+			return false;
+		}
 		break;
 	    case A_ARRAY:
 		if (!expand_line(assign->a_array, &count, &values))
 		    return false;
 		assert(values != NULL);
 		if (shopt_xtrace)
-		    xtrace_array(assign->a_name, values);
-		if (!set_array(assign->a_name, count, values, scope, export))
-		    return false;
+		    xtrace_array(assign->a_name, append, values);
+		if (append) {
+		    if (!append_to_array(
+				assign->a_name, count, values, scope, export))
+			return false;
+		} else {
+		    if (!set_array(
+				assign->a_name, count, values, scope, export))
+			return false;
+		}
 		break;
 	}
 	assign = assign->next;
@@ -764,22 +1153,70 @@ bool do_assignments(const assign_T *assign, bool temp, bool export)
     return true;
 }
 
+/* Checks if the value of a scalar assignment starts with a parameter expansion
+ * of the assigned variable itself, as in `x=$x$y' or `x="${x}y"', so that the
+ * assignment can be performed by appending the rest of the value to the
+ * current value of the variable.
+ * If so, `*wordp' is updated to point to the rest of the value and true is
+ * returned. If the value starts with a double quote, `*quote' is made a copy of
+ * the quote that precedes the rest of the value, in which case `*wordp' is
+ * made to point to `*quote'. */
+bool skip_self_reference(
+	const wchar_t *name, const wordunit_T **wordp, wordunit_T *quote)
+{
+    const wordunit_T *w = *wordp;
+    bool quoted = w != NULL && w->wu_type == WT_STRING
+	&& wcscmp(w->wu_string, L"\"") == 0;
+    if (quoted)
+	w = w->next;
+    if (w == NULL || w->wu_type != WT_PARAM)
+	return false;
+
+    const paramexp_T *p = w->wu_param;
+    if (p->pe_type != PT_NONE || p->pe_start != NULL || p->pe_end != NULL
+	    || wcscmp(p->pe_name, name) != 0)
+	return false;
+    w = w->next;
+
+    /* Tilde expansion at the start of the rest would not be performed on the
+     * whole value. The expansion of the rest must not assign the variable. */
+    if (!quoted && w != NULL && w->wu_type == WT_STRING
+	    && w->wu_string[0] == L'~')
+	return false;
+    if (!is_safe_word(w))
+	return false;
+
+    variable_T *var = search_appendable_variable(name);
+    if (var == NULL || (var->v_type & VF_MASK) != VF_SCALAR
+	    || var->v_value == NULL)
+	return false;
+
+    if (quoted) {
+	quote->next = (wordunit_T *) w;
+	quote->wu_type = WT_STRING;
+	quote->wu_string = (wchar_t *) L"\"";
+	w = quote;
+    }
+    *wordp = w;
+    return true;
+}
+
 /* Pushes a trace of the specified variable assignment to the xtrace buffer. */
-void xtrace_variable(const wchar_t *name, const wchar_t *value)
+void xtrace_variable(const wchar_t *name, bool append, const wchar_t *value)
 {
     xwcsbuf_T *buf = get_xtrace_buffer();
     wb_wccat(buf, L' ');
     wb_cat(buf, name);
-    wb_wccat(buf, L'=');
+    wb_cat(buf, append ? L"+=" : L"=");
     wb_quote_as_word(buf, value);
 }
 
 /* Pushes a trace of the specified array assignment to the xtrace buffer. */
-void xtrace_array(const wchar_t *name, void *const *values)
+void xtrace_array(const wchar_t *name, bool append, void *const *values)
 {
     xwcsbuf_T *buf = get_xtrace_buffer();
 
-    wb_wprintf(buf, L" %ls=(", name);
+    wb_wprintf(buf, L" %ls%ls(", name, append ? L"+=" : L"=");
     if (*values != NULL) {
 	for (;;) {
 	    wb_quote_as_word(buf, *values);
@@ -1032,6 +1469,7 @@ void lineno_getter(variable_T *var)
     assert((var->v_type & VF_MASK) == VF_SCALAR);
     free(var->v_value);
     var->v_value = malloc_wprintf(L"%lu", current_lineno);
+    var->v_capacity = 0;
     // variable_set(VAR_LINENO, var);
     if (var->v_type & VF_EXPORT)
 	update_environment(L VAR_LINENO);
@@ -1043,6 +1481,7 @@ void random_getter(variable_T *var)
     assert((var->v_type & VF_MASK) == VF_SCALAR);
     free(var->v_value);
     var->v_value = malloc_wprintf(L"%u", next_random());
+    var->v_capacity = 0;
     // variable_set(VAR_RANDOM, var);
     if (var->v_type & VF_EXPORT)
 	update_environment(L VAR_RANDOM);
@@ -1089,8 +1528,8 @@ void variable_set(const wchar_t *name, variable_T *var)
 	break;
     case L'P':
 	if (wcscmp(name, L VAR_PATH) == 0) {
-	    clear_cmdhash();
 	    reset_path(PA_PATH, var);
+	    clear_cmdhash();
 	}
 	break;
     case L'R':
@@ -1603,12 +2042,16 @@ static struct promptset_T promptset_for_read(
 static wchar_t *read_one_line_with_prompt(
 	struct promptset_T prompt, bool lineedit)
     __attribute__((malloc,warn_unused_result));
-static wchar_t *read_one_line(void)
+static wchar_t *read_one_line(bool readahead)
     __attribute__((malloc,warn_unused_result));
 static bool unescape_line(const wchar_t *line, xwcsbuf_T *buf, xstrbuf_T *split)
     __attribute__((nonnull));
 static void assign_array(const wchar_t *name, const plist_T *ranges, size_t i)
     __attribute__((nonnull));
+#if YASH_ENABLE_ARRAY
+static bool read_array_elements(plist_T *list, wchar_t delimiter, bool trim)
+    __attribute__((nonnull));
+#endif
 
 /* Options for the "typeset" built-in. */
 const struct xgetopt_T typeset_options[] = {
@@ -1708,7 +2151,7 @@ int typeset_builtin(int argc, void **argv)
 	if (!function) {
 	    /* print all variables */
 	    count = make_array_of_all_variables(global, &kvs);
-	    qsort(kvs, count, sizeof *kvs, keywcscoll);
+	    sort_by_collation(kvs, count, sizeof *kvs, keywcs, NULL);
 	    for (size_t i = 0; yash_error_message_count == 0 && i < count; i++)
 		print_variable(
 			kvs[i].key, kvs[i].value, ARGV(0), readonly, export);
@@ -1716,7 +2159,7 @@ int typeset_builtin(int argc, void **argv)
 	    /* print all functions */
 	    kvs = ht_tokvarray(&functions);
 	    count = functions.count;
-	    qsort(kvs, count, sizeof *kvs, keywcscoll);
+	    sort_by_collation(kvs, count, sizeof *kvs, keywcs, NULL);
 	    for (size_t i = 0; yash_error_message_count == 0 && i < count; i++)
 		print_function(kvs[i].key, kvs[i].value, ARGV(0), readonly);
 	}
@@ -1739,6 +2182,7 @@ int typeset_builtin(int argc, void **argv)
 			    varvaluefree(var);
 			    var->v_type = VF_SCALAR | (var->v_type & ~VF_MASK);
 			    var->v_value = xwcsdup(&wequal[1]);
+			    var->v_capacity = 0;
 			    var->v_getter = NULL;
 			}
 		    }
@@ -2102,7 +2546,7 @@ int array_dump_all(const wchar_t *argv0)
 {
     kvpair_T *kvs;
     size_t count = make_array_of_all_variables(true, &kvs);
-    qsort(kvs, count, sizeof *kvs, keywcscoll);
+    sort_by_collation(kvs, count, sizeof *kvs, keywcs, NULL);
     for (size_t i = 0; yash_error_message_count == 0 && i < count; i++) {
 	variable_T *var = kvs[i].value;
 	if ((var->v_type & VF_MASK) == VF_ARRAY)
@@ -2147,21 +2591,15 @@ void array_remove_elements(
 
     /* remove elements in descending order so that an earlier removal does not
      * affect the indices for later removals. */
-    plist_T list;
     long lastindex = LONG_MIN;
-    pl_initwith(&list, array->v_vals, array->v_valc);
     for (size_t i = count; i-- != 0; ) {
 	long index = indices[i];
 	if (index == lastindex)
 	    continue;
-	if (0 <= index && LONG_LT_SIZE(index, list.length)) {
-	    free(list.contents[index]);
-	    pl_remove(&list, index, 1);
-	}
+	if (0 <= index && LONG_LT_SIZE(index, array->v_valc))
+	    delete_array_range(array, (size_t) index, 1);
 	lastindex = index;
     }
-    array->v_valc = list.length;
-    array->v_vals = pl_toary(&list);
 }
 
 int compare_long(const void *lp1, const void *lp2)
@@ -2207,13 +2645,9 @@ void array_insert_elements(
     else
 	uindex = array->v_valc;
 
-    plist_T list;
-    pl_initwith(&list, array->v_vals, array->v_valc);
-    pl_insert(&list, uindex, values);
+    insert_array_range(array, uindex, count, values);
     for (size_t i = 0; i < count; i++)
-	list.contents[uindex + i] = xwcsdup(list.contents[uindex + i]);
-    array->v_valc = list.length;
-    array->v_vals = pl_toary(&list);
+	array->v_vals[uindex + i] = xwcsdup(array->v_vals[uindex + i]);
 }
 
 /* Sets the value of the specified element of the array.
@@ -2464,13 +2898,7 @@ int shift_builtin(int argc, void **argv)
     }
 
     size_t from = (count >= 0) ? 0 : (var->v_valc - (size_t) abscount);
-    plist_T list;
-    pl_initwith(&list, var->v_vals, var->v_valc);
-    for (size_t i = 0; i < (size_t) abscount; i++)
-	free(list.contents[from + i]);
-    pl_remove(&list, from, (size_t) abscount);
-    var->v_valc = list.length;
-    var->v_vals = pl_toary(&list);
+    delete_array_range(var, from, (size_t) abscount);
 
     return Exit_SUCCESS;
 }
@@ -2572,6 +3000,7 @@ parse_arg:
 	if (options[0] == L':') {
 	    TRY(set_variable_single_char(L VAR_OPTARG, optchar));
 	} else {
+	    flush_stdout();
 	    fprintf(stderr, gt("%ls: `-%lc' is not a valid option\n"),
 		    command_name, (wint_t) optchar);
 	    TRY(!unset_variable(L VAR_OPTARG));
@@ -2594,6 +3023,7 @@ parse_arg:
 			TRY(set_variable_single_char(varname, L':'));
 			TRY(set_variable_single_char(L VAR_OPTARG, optchar));
 		    } else {
+			flush_stdout();
 			fprintf(stderr,
 			    gt("%ls: the -%lc option's argument is missing\n"),
 			    command_name, (wint_t) optchar);
@@ -2683,6 +3113,7 @@ const char getopts_syntax[] = Ngt(
 /* Options for the "read" built-in. */
 const struct xgetopt_T read_options[] = {
     { L'A', L"array",        OPTARG_NONE,     false, NULL, },
+    { L'b', L"buffered",     OPTARG_NONE,     false, NULL, },
     { L'e', L"line-editing", OPTARG_NONE,     false, NULL, },
     { L'P', L"ps1",          OPTARG_NONE,     false, NULL, },
     { L'p', L"prompt",       OPTARG_REQUIRED, false, NULL, },
@@ -2694,12 +3125,13 @@ const struct xgetopt_T read_options[] = {
 };
 
 struct reading_option_T {
-    bool array, lineedit, ps1, raw;
+    bool array, buffered, lineedit, ps1, raw;
     const wchar_t *prompt;
 };
 
 /* The "read" built-in, which accepts the following options:
  *  -A: assign values to array
+ *  -b: read ahead from the standard input
  *  -e: use line-editing
  *  -P: use $PS1
  *  -p: specify prompt
@@ -2709,6 +3141,7 @@ int read_builtin(int argc, void **argv)
 {
     struct reading_option_T ro = {
 	.array = false,
+	.buffered = false,
 	.lineedit = false,
 	.ps1 = false,
 	.raw = false,
@@ -2720,6 +3153,7 @@ int read_builtin(int argc, void **argv)
     while ((opt = xgetopt(argv, read_options, 0)) != NULL) {
 	switch (opt->shortopt) {
 	    case L'A':  ro.array    = true;     break;
+	    case L'b':  ro.buffered = true;     break;
 	    case L'e':  ro.lineedit = true;     break;
 	    case L'P':  ro.ps1      = true;     break;
 	    case L'p':  ro.prompt   = xoptarg;  break;
@@ -2831,7 +3265,12 @@ bool read_with_prompt(xwcsbuf_T *buf, xstrbuf_T *split,
 {
     bool firstline = true;
     bool completed = false;
-    bool use_prompt = is_interactive_now && isatty(STDIN_FILENO);
+    bool is_tty = isatty(STDIN_FILENO);
+    bool use_prompt = is_interactive_now && is_tty;
+
+    /* Let the user see the preceding output before waiting for input. */
+    if (is_tty)
+	flush_stdout();
 
     while (!completed) {
 	wchar_t *line;
@@ -2840,7 +3279,7 @@ bool read_with_prompt(xwcsbuf_T *buf, xstrbuf_T *split,
 	    line = read_one_line_with_prompt(prompt, ro->lineedit);
 	    free_prompt(prompt);
 	} else {
-	    line = read_one_line();
+	    line = read_one_line(ro->buffered && !is_tty);
 	}
 	if (line == NULL)
 	    return false;
@@ -2904,7 +3343,7 @@ wchar_t *read_one_line_with_prompt(struct promptset_T prompt, bool lineedit)
     print_prompt(prompt.main);
     print_prompt(prompt.styler);
 
-    line = read_one_line();
+    line = read_one_line(false);
 
     print_prompt(PROMPT_RESET);
 
@@ -2913,13 +3352,18 @@ wchar_t *read_one_line_with_prompt(struct promptset_T prompt, bool lineedit)
 
 /* Reads one line from the standard input without printing any prompt or using
  * line-editing.
+ * If `readahead' is true, more bytes than the line may be read from the
+ * standard input. They are left in `stdin_input_file_info' for the next read.
  * The result is returned as a newly-malloced wide string. The result is null
  * iff an error occurs. */
-wchar_t *read_one_line(void)
+wchar_t *read_one_line(bool readahead)
 {
     xwcsbuf_T buf;
     wb_init(&buf);
-    if (read_input(&buf, stdin_input_file_info, false) != INPUT_ERROR)
+    stdin_input_file_info->readahead = readahead;
+    inputresult_T result = read_input(&buf, stdin_input_file_info, false);
+    stdin_input_file_info->readahead = false;
+    if (result != INPUT_ERROR)
 	return wb_towcs(&buf);
     wb_destroy(&buf);
     return NULL;
@@ -2987,10 +3431,155 @@ const char read_help[] = Ngt(
 "read a line from the standard input"
 );
 const char read_syntax[] = Ngt(
-"\tread [-Aer] [-P|-p] variable...\n"
+"\tread [-Aber] [-P|-p] variable...\n"
 );
 #endif
 
+#if YASH_ENABLE_ARRAY
+
+/* Options for the "readarray" built-in. */
+const struct xgetopt_T readarray_options[] = {
+    { L'd', L"delimiter", OPTARG_REQUIRED, false, NULL, },
+    { L't', L"trim",      OPTARG_NONE,     false, NULL, },
+#if YASH_ENABLE_HELP
+    { L'-', L"help",      OPTARG_NONE,     false, NULL, },
+#endif
+    { L'\0', NULL, 0, false, NULL, },
+};
+
+/* The "readarray" built-in, which accepts the following options:
+ *  -d: specify the delimiter
+ *  -t: remove the delimiter from each element */
+int readarray_builtin(int argc, void **argv)
+{
+    wchar_t delimiter = L'\n';
+    bool trim = false;
+
+    const struct xgetopt_T *opt;
+    xoptind = 0;
+    while ((opt = xgetopt(argv, readarray_options, 0)) != NULL) {
+	switch (opt->shortopt) {
+	    case L'd':
+		if (xoptarg[0] != L'\0' && xoptarg[1] != L'\0') {
+		    xerror(0, Ngt("the delimiter must be a single character"));
+		    return Exit_ERROR;
+		}
+		delimiter = xoptarg[0];
+		break;
+	    case L't':
+		trim = true;
+		break;
+#if YASH_ENABLE_HELP
+	    case L'-':
+		return print_builtin_help(ARGV(0));
+#endif
+	    default:
+		return Exit_ERROR;
+	}
+    }
+
+    if (!validate_operand_count(argc - xoptind, 1, 1))
+	return Exit_ERROR;
+
+    const wchar_t *name = ARGV(xoptind);
+    if (wcschr(name, L'=') != NULL) {
+	xerror(0, Ngt("`%ls' is not a valid array name"), name);
+	return Exit_FAILURE;
+    }
+
+    plist_T list;
+    pl_init(&list);
+    if (!read_array_elements(&list, delimiter, trim)) {
+	plfree(pl_toary(&list), free);
+	return Exit_FAILURE;
+    }
+
+    /* The spare room in the list is kept as the capacity of the array so that
+     * elements can be appended to it later without reallocation. */
+    size_t capacity = list.maxlength;
+    variable_T *array = set_array(name, list.length, pl_toary(&list),
+	    SCOPE_GLOBAL, shopt_allexport);
+    if (array == NULL)
+	return Exit_FAILURE;
+    array->v_valcap = capacity;
+    return (yash_error_message_count == 0) ? Exit_SUCCESS : Exit_FAILURE;
+}
+
+/* Reads the standard input until the end of input and adds the elements
+ * terminated by `delimiter' to `list' as newly-malloced wide strings.
+ * If `trim' is true, the delimiter is removed from each element. The last
+ * element may lack the delimiter. Null characters in the input are ignored
+ * unless the delimiter is the null character.
+ * The input is read in blocks of `stdin_input_file_info->bufsize' bytes, so the
+ * memory used in addition to the result does not depend on the input size
+ * except for the longest element.
+ * Returns false on error. */
+bool read_array_elements(plist_T *list, wchar_t delimiter, bool trim)
+{
+    struct input_file_info_T *info = stdin_input_file_info;
+    xwcsbuf_T element;
+    bool ok = true;
+
+    wb_init(&element);
+    info->readahead = true;
+    for (;;) {
+	if (info->bufpos >= info->bufmax) {
+	    inputresult_T result = fill_input_buffer(info, false);
+	    if (result == INPUT_EOF)
+		break;
+	    if (result != INPUT_OK) {
+		ok = false;
+		break;
+	    }
+	}
+
+	wchar_t c;
+	size_t convcount = mbrtowc(&c, &info->buf[info->bufpos],
+		info->bufmax - info->bufpos, &info->state);
+	switch (convcount) {
+	    case 0:  /* null character, which is a single byte */
+		info->bufpos++;
+		break;
+	    case (size_t) -1:  /* not a valid character */
+		xerror(errno, Ngt("cannot read input"));
+		ok = false;
+		goto end;
+	    case (size_t) -2:  /* needs more input */
+		info->bufpos = info->bufmax;
+		continue;
+	    default:
+		info->bufpos += convcount;
+		break;
+	}
+
+	if (c == delimiter) {
+	    if (!trim && c != L'\0')
+		wb_wccat(&element, c);
+	    pl_add(list, xwcsndup(element.contents, element.length));
+	    wb_clear(&element);
+	} else if (c != L'\0') {
+	    wb_wccat(&element, c);
+	}
+    }
+end:
+    info->readahead = false;
+    if (ok && element.length > 0)
+	pl_add(list, xwcsndup(element.contents, element.length));
+    wb_destroy(&element);
+    return ok;
+}
+
+#if YASH_ENABLE_HELP
+const char readarray_help[] = Ngt(
+"read lines from the standard input into an array"
+);
+const char readarray_syntax[] = Ngt(
+"\treadarray [-t] [-d delimiter] array\n"
+);
+#endif
+
+#endif /* YASH_ENABLE_ARRAY */
+
 /* options for the "pushd" built-in */
 const struct xgetopt_T pushd_options[] = {
 #if YASH_ENABLE_DIRSTACK
@@ -3133,10 +3722,9 @@ variable_T *get_dirstack(void)
  * modify or free `value' after calling this function. */
 void push_dirstack(variable_T *var, wchar_t *value)
 {
-    size_t index = var->v_valc++;
-    var->v_vals = xrealloce(var->v_vals, index, 2, sizeof *var->v_vals);
-    var->v_vals[index] = value;
-    var->v_vals[index + 1] = NULL;
+    reserve_array_room(var, 0, 1);
+    var->v_vals[var->v_valc++] = value;
+    var->v_vals[var->v_valc] = NULL;
 }
 
 /* Removes the directory stack entry specified by `index'.
@@ -3145,10 +3733,7 @@ void push_dirstack(variable_T *var, wchar_t *value)
 void remove_dirstack_entry_at(variable_T *var, size_t index)
 {
     assert(index < var->v_valc);
-    free(var->v_vals[index]);
-    memmove(&var->v_vals[index], &var->v_vals[index + 1],
-	    (var->v_valc - index) * sizeof *var->v_vals);
-    var->v_valc--;
+    delete_array_range(var, index, 1);
 }
 
 /* Removes directory stack entries that are the same as the current working
@@ -82,11 +82,14 @@ typedef enum path_T {
     PA_count,
 } path_T;
 
+extern unsigned long locale_generation;
+
 extern void init_environment(void);
 extern void init_variables(void);
 
 extern char *get_exported_value(const wchar_t *name)
     __attribute__((nonnull,malloc,warn_unused_result));
+extern char **get_environ(void);
 
 typedef enum scope_T {
     SCOPE_GLOBAL, SCOPE_LOCAL, SCOPE_TEMP,
@@ -184,6 +187,13 @@ extern const char read_help[], read_syntax[];
 #endif
 extern const struct xgetopt_T read_options[];
 
+extern int readarray_builtin(int argc, void **argv)
+    __attribute__((nonnull));
+#if YASH_ENABLE_HELP
+extern const char readarray_help[], readarray_syntax[];
+#endif
+extern const struct xgetopt_T readarray_options[];
+
 extern int pushd_builtin(int argc, void **argv)
     __attribute__((nonnull));
 #if YASH_ENABLE_HELP
@@ -24,15 +24,65 @@
 #include <stdlib.h>
 #include <string.h>
 #include <wchar.h>
+#include <wctype.h>
 #include "strbuf.h"
 #include "util.h"
 
 
+/* type of patelem_T */
+typedef enum {
+    PE_CHAR,     /* ordinary character */
+    PE_ANY,      /* "?" */
+    PE_STAR,     /* "*" */
+    PE_BRACKET,  /* bracket expression */
+} patelemtype_T;
+
+/* element of a pattern compiled for the native matcher */
+typedef struct patelem_T {
+    patelemtype_T type;
+    union {
+	wchar_t c;
+	struct bracket_T *bracket;
+    } value;
+} patelem_T;
+
+/* type of bracketitem_T */
+typedef enum {
+    BR_CHAR,   /* single character */
+    BR_RANGE,  /* range expression like "a-z" */
+    BR_CLASS,  /* character class like "[:alpha:]" */
+} bracketitemtype_T;
+
+/* element of a bracket expression */
+typedef struct bracketitem_T {
+    bracketitemtype_T type;
+    wchar_t min, max;  /* for BR_CHAR, only `min' is used */
+    wctype_t class;    /* only for BR_CLASS */
+} bracketitem_T;
+
+/* compiled bracket expression */
+typedef struct bracket_T {
+    bool negated;
+    size_t count;
+    bracketitem_T items[];
+} bracket_T;
+
+/* result of parsing (part of) a bracket expression */
+typedef enum {
+    PARSE_OK,           /* successfully parsed */
+    PARSE_INVALID,      /* not a valid bracket expression */
+    PARSE_UNSUPPORTED,  /* valid but not supported by the native matcher */
+} parseresult_T;
+
 struct xfnmatch_T {
     xfnmflags_T flags;
     union {
 	regex_t regex;
 	xwcsbuf_T literal;
+	struct {
+	    size_t count;
+	    patelem_T *elems;
+	} native;
     } value;
 };
 /* The flags are logical OR of the followings:
@@ -42,6 +92,7 @@ struct xfnmatch_T {
  *  XFNM_PERIOD:    don't match with a string that starts with a period
  *  XFNM_CASEFOLD:  ignore case while matching
  *  XFNM_compiled:  use `regex' rather than `literal'
+ *  XFNM_native:    use `native' rather than `literal'
  * When XFNM_SHORTEST is specified, either (but not both) of XFNM_HEADONLY and
  * XFNM_TAILONLY must be also specified. When XFNM_PERIOD is specified,
  * XFNM_HEADONLY must be also specified. */
@@ -49,10 +100,28 @@ struct xfnmatch_T {
 #define XFNM_HEADTAIL (XFNM_HEADONLY | XFNM_TAILONLY)
 #define MISMATCH ((xfnmresult_T) { (size_t) -1, (size_t) -1, })
 
+/* The number of automaton states of the native matcher that are kept in the
+ * stack rather than the heap. */
+#ifndef NATIVE_STATES_ON_STACK
+#define NATIVE_STATES_ON_STACK 64
+#endif
+
 static bool is_matching_pattern_bracket(const wchar_t *pat)
     __attribute__((nonnull,pure));
 static xfnmatch_T *try_compile_literal(const wchar_t *pat, xfnmflags_T flags)
     __attribute__((malloc,warn_unused_result,nonnull));
+static xfnmatch_T *try_compile_native(const wchar_t *pat, xfnmflags_T flags)
+    __attribute__((malloc,warn_unused_result,nonnull));
+static parseresult_T compile_native_bracket(const wchar_t **restrict patp,
+	patelem_T *restrict elem, xfnmflags_T flags)
+    __attribute__((nonnull));
+static parseresult_T parse_bracket_item(const wchar_t **restrict patp,
+	bracketitem_T *restrict item, xfnmflags_T flags)
+    __attribute__((nonnull));
+static parseresult_T parse_bracket_char(const wchar_t **restrict patp,
+	wchar_t *restrict cp, bool *restrict collsymp)
+    __attribute__((nonnull));
+static void free_native(size_t count, patelem_T *elems);
 static xfnmatch_T *try_compile_regex(const wchar_t *pat, xfnmflags_T flags)
     __attribute__((malloc,warn_unused_result,nonnull));
 static void encode_pattern(const wchar_t *restrict pat, xstrbuf_T *restrict buf)
@@ -72,6 +141,33 @@ static xfnmresult_T wmatch_literal(
 static wchar_t *last_wcsstr(
 	const wchar_t *restrict s, const wchar_t *restrict sub)
     __attribute__((nonnull));
+static inline bool match_elem(
+	const patelem_T *e, wchar_t c, xfnmflags_T flags)
+    __attribute__((nonnull,pure));
+static bool match_bracket(const bracket_T *b, wchar_t c, xfnmflags_T flags)
+    __attribute__((nonnull,pure));
+static bool match_bracket_items(const bracket_T *b, wchar_t c)
+    __attribute__((nonnull,pure));
+static xfnmresult_T wmatch_native(
+	const xfnmatch_T *restrict xfnm, const wchar_t *restrict s)
+    __attribute__((nonnull));
+static bool match_native_whole(
+	const xfnmatch_T *restrict xfnm, const wchar_t *restrict s)
+    __attribute__((nonnull,pure));
+static size_t match_native_prefix(
+	const xfnmatch_T *restrict xfnm, const wchar_t *restrict s,
+	bool shortest)
+    __attribute__((nonnull));
+static inline void add_state(
+	bool *restrict states, const xfnmatch_T *restrict xfnm, size_t i)
+    __attribute__((nonnull));
+static xfnmresult_T match_native_tail(
+	const xfnmatch_T *restrict xfnm, const wchar_t *restrict s,
+	bool shortest)
+    __attribute__((nonnull));
+static xfnmresult_T match_native_anywhere(
+	const xfnmatch_T *restrict xfnm, const wchar_t *restrict s)
+    __attribute__((nonnull));
 static xfnmresult_T wmatch_headtail(
 	const regex_t *restrict regex, const wchar_t *restrict s)
     __attribute__((nonnull));
@@ -201,12 +297,17 @@ xfnmatch_T *xfnm_compile(const wchar_t *pat, xfnmflags_T flags)
 	    flags &= ~XFNM_PERIOD;
     }
 
+    xfnmatch_T *result;
     if (!(flags & XFNM_CASEFOLD)) {
-	xfnmatch_T *result = try_compile_literal(pat, flags);
+	result = try_compile_literal(pat, flags);
 	if (result != NULL)
 	    return result;
     }
 
+    result = try_compile_native(pat, flags);
+    if (result != NULL)
+	return result;
+
     return try_compile_regex(pat, flags);
 }
 
@@ -271,6 +372,230 @@ fail:
     return NULL;
 }
 
+/* Compiles the specified pattern into a sequence of elements that are matched
+ * by the native matcher, which works directly on wide strings.
+ * Returns NULL if the pattern contains an equivalence class, a multi-character
+ * collating symbol, or any other construct that the native matcher does not
+ * support, in which case the pattern should be compiled into a regex. */
+xfnmatch_T *try_compile_native(const wchar_t *pat, xfnmflags_T flags)
+{
+    patelem_T *elems = xmallocn(wcslen(pat) + 1, sizeof *elems);
+    size_t count = 0;
+
+    for (; *pat != L'\0'; pat++) {
+	patelem_T *e = &elems[count];
+	switch (*pat) {
+	    case L'?':
+		e->type = PE_ANY;
+		break;
+	    case L'*':
+		if (count > 0 && elems[count - 1].type == PE_STAR)
+		    continue;
+		e->type = PE_STAR;
+		break;
+	    case L'[':
+		switch (compile_native_bracket(&pat, e, flags)) {
+		    case PARSE_OK:           break;
+		    case PARSE_INVALID:      goto ordinary;
+		    case PARSE_UNSUPPORTED:  goto fail;
+		}
+		break;
+	    case L'\\':
+		pat++;
+		if (*pat == L'\0')
+		    goto success;
+		/* falls thru */
+	    default:  ordinary:
+		e->type = PE_CHAR;
+		e->value.c = *pat;
+		break;
+	}
+	count++;
+    }
+
+success:;
+    xfnmatch_T *xfnm = xmalloc(sizeof *xfnm);
+    xfnm->flags = flags | XFNM_native;
+    xfnm->value.native.count = count;
+    xfnm->value.native.elems = elems;
+    return xfnm;
+fail:
+    free_native(count, elems);
+    return NULL;
+}
+
+/* Compiles the bracket expression that starts with the opening bracket '['
+ * pointed to by `*patp'.
+ * If the bracket expression is successfully compiled, the result is stored in
+ * `*elem', `*patp' is updated to point to the closing bracket ']', and
+ * PARSE_OK is returned. If the bracket expression is not valid, in which case
+ * the opening bracket should be treated as an ordinary character,
+ * PARSE_INVALID is returned. If it is valid but not supported by the native
+ * matcher, PARSE_UNSUPPORTED is returned.
+ * Backslash escapes are recognized in the bracket expression. */
+/* This function must agree with `encode_pattern_bracket' on the syntax. */
+parseresult_T compile_native_bracket(const wchar_t **restrict patp,
+	patelem_T *restrict elem, xfnmflags_T flags)
+{
+    const wchar_t *pat = *patp;
+    size_t max = 8;
+    bracket_T *bracket = xmallocs(sizeof *bracket, max, sizeof *bracket->items);
+
+    bracket->negated = false;
+    bracket->count = 0;
+    assert(*pat == L'[');
+    pat++;
+    if (*pat == L'!' || *pat == L'^') {
+	bracket->negated = true;
+	pat++;
+    }
+    do {
+	if (bracket->count == max) {
+	    max *= 2;
+	    bracket = xreallocs(bracket,
+		    sizeof *bracket, max, sizeof *bracket->items);
+	}
+	/* The first item may be a bracket, which is an ordinary character. */
+	parseresult_T result = parse_bracket_item(
+		&pat, &bracket->items[bracket->count++], flags);
+	if (result != PARSE_OK) {
+	    free(bracket);
+	    return result;
+	}
+    } while (*pat != L']');
+
+    elem->type = PE_BRACKET;
+    elem->value.bracket = bracket;
+    *patp = pat;
+    return PARSE_OK;
+}
+
+/* Parses an item of a bracket expression: a character class, a character, or
+ * a range expression.
+ * On success, the result is stored in `*item' and `*patp' is updated to point
+ * to the character just after the item. */
+parseresult_T parse_bracket_item(const wchar_t **restrict patp,
+	bracketitem_T *restrict item, xfnmflags_T flags)
+{
+    const wchar_t *pat = *patp;
+
+    if (pat[0] == L'[' && pat[1] == L':') {
+	const wchar_t *p = wcsstr(&pat[2], L":]");
+	if (p == NULL)
+	    return PARSE_INVALID;
+
+	wchar_t *name = xwcsndup(&pat[2], p - &pat[2]);
+	char *mbsname = (wcschr(name, L'\\') == NULL)
+	    ? malloc_wcstombs(name) : NULL;
+	free(name);
+	if (mbsname == NULL)
+	    return PARSE_UNSUPPORTED;
+	item->type = BR_CLASS;
+	item->class = wctype(mbsname);
+	free(mbsname);
+	if (item->class == 0)
+	    return PARSE_UNSUPPORTED;
+	pat = &p[2];
+	if (pat[0] == L'-' && pat[1] != L']' && pat[1] != L'\0')
+	    return PARSE_UNSUPPORTED;  /* class as a range start is an error */
+	*patp = pat;
+	return PARSE_OK;
+    }
+
+    bool collsym;
+    parseresult_T result = parse_bracket_char(&pat, &item->min, &collsym);
+    if (result != PARSE_OK)
+	return result;
+    item->type = BR_CHAR;
+
+    if (pat[0] == L'-' && pat[1] != L']' && pat[1] != L'\0') {
+	/* The meaning of a range depends on the collation order of the
+	 * locale, so ranges are left to regex unless the locale is the POSIX
+	 * locale, where ranges are in the order of character codes. Ranges
+	 * that have a collating symbol as an end point and case-insensitive
+	 * ranges are always left to regex. */
+	if (collsym || (flags & XFNM_CASEFOLD) || !is_posix_collation())
+	    return PARSE_UNSUPPORTED;
+	pat++;
+	result = parse_bracket_char(&pat, &item->max, &collsym);
+	if (result != PARSE_OK)
+	    return result;
+	if (collsym || item->min > item->max || item->max > 0x7F)
+	    return PARSE_UNSUPPORTED;
+	if (pat[0] == L'-' && pat[1] != L']')
+	    return PARSE_UNSUPPORTED;  /* like "a-c-e", which is undefined */
+	item->type = BR_RANGE;
+    }
+
+    *patp = pat;
+    return PARSE_OK;
+}
+
+/* Parses a character in a bracket expression, which may be escaped by a
+ * backslash or written as a single-character collating symbol.
+ * On success, the character is stored in `*cp' and `*patp' is updated to point
+ * to the character just after the parsed one. `*collsymp' is set to true iff
+ * the character is a collating symbol or an escaped character that is
+ * converted to a collating symbol by `encode_pattern_bracket'. */
+parseresult_T parse_bracket_char(const wchar_t **restrict patp,
+	wchar_t *restrict cp, bool *restrict collsymp)
+{
+    const wchar_t *pat = *patp;
+
+    *collsymp = false;
+    switch (pat[0]) {
+	case L'\0':
+	    return PARSE_INVALID;
+	case L'[':;
+	    const wchar_t *p;
+	    switch (pat[1]) {
+		case L'.':  p = wcsstr(&pat[2], L".]");  break;
+		case L':':  p = wcsstr(&pat[2], L":]");  break;
+		case L'=':  p = wcsstr(&pat[2], L"=]");  break;
+		case L'\\':
+		    /* In regex, an escaped character after a bracket would be
+		     * part of the bracket. */
+		    if (pat[2] == L'.' || pat[2] == L':' || pat[2] == L'=')
+			return PARSE_UNSUPPORTED;
+		    /* falls thru */
+		default:
+		    goto ordinary;
+	    }
+	    if (p == NULL)
+		return PARSE_INVALID;
+	    /* Only single-character collating symbols are supported. */
+	    if (pat[1] != L'.' || p != &pat[3] || pat[2] == L'\\')
+		return PARSE_UNSUPPORTED;
+	    *cp = pat[2];
+	    *patp = &p[2];
+	    *collsymp = true;
+	    return PARSE_OK;
+	case L'\\':
+	    pat++;
+	    switch (pat[0]) {
+		case L'\0':
+		    return PARSE_INVALID;
+		case L'[':  case L'^':  case L'-':  case L']':
+		    *collsymp = true;
+		    break;
+	    }
+	    /* falls thru */
+	default:  ordinary:
+	    *cp = pat[0];
+	    *patp = &pat[1];
+	    return PARSE_OK;
+    }
+}
+
+/* Frees the specified pattern elements. */
+void free_native(size_t count, patelem_T *elems)
+{
+    for (size_t i = 0; i < count; i++)
+	if (elems[i].type == PE_BRACKET)
+	    free(elems[i].value.bracket);
+    free(elems);
+}
+
 /* Compiles the specified pattern.
  * Returns NULL on error. */
 xfnmatch_T *try_compile_regex(const wchar_t *pat, xfnmflags_T flags)
@@ -497,6 +822,9 @@ xfnmresult_T xfnm_wmatch(
 	if (s[0] == L'.')
 	    return MISMATCH;
     }
+    if (flags & XFNM_native) {
+	return wmatch_native(xfnm, s);
+    }
     if (!(flags & XFNM_compiled)) {
 	return wmatch_literal(xfnm, s);
     }
@@ -585,6 +913,233 @@ wchar_t *last_wcsstr(const wchar_t *restrict s, const wchar_t *restrict sub)
     return lastresult;
 }
 
+/* Performs matching on string `s' using pre-compiled native pattern `xfnm'.
+ * See the `xfnm_wmatch' function. */
+xfnmresult_T wmatch_native(
+	const xfnmatch_T *restrict xfnm, const wchar_t *restrict s)
+{
+    bool shortest = xfnm->flags & XFNM_SHORTEST;
+    switch (xfnm->flags & XFNM_HEADTAIL) {
+	case XFNM_HEADTAIL:
+	    if (match_native_whole(xfnm, s))
+		return (xfnmresult_T) { .start = 0 };
+	    return MISMATCH;
+	case XFNM_HEADONLY:;
+	    size_t length = match_native_prefix(xfnm, s, shortest);
+	    if (length == (size_t) -1)
+		return MISMATCH;
+	    return (xfnmresult_T) { .start = 0, .end = length };
+	case XFNM_TAILONLY:
+	    return match_native_tail(xfnm, s, shortest);
+	default:
+	    assert(!shortest);
+	    return match_native_anywhere(xfnm, s);
+    }
+}
+
+/* Tests if character `c' matches pattern element `e', which must not be
+ * PE_STAR. */
+bool match_elem(const patelem_T *e, wchar_t c, xfnmflags_T flags)
+{
+    switch (e->type) {
+	case PE_CHAR:
+	    if (e->value.c == c)
+		return true;
+	    return (flags & XFNM_CASEFOLD) && towlower(e->value.c) == towlower(c);
+	case PE_ANY:
+	    return true;
+	case PE_BRACKET:
+	    return match_bracket(e->value.bracket, c, flags);
+	case PE_STAR:
+	    break;
+    }
+    assert(false);
+    return false;
+}
+
+/* Tests if character `c' matches bracket expression `b'. */
+bool match_bracket(const bracket_T *b, wchar_t c, xfnmflags_T flags)
+{
+    bool match = match_bracket_items(b, c);
+    if (!match && (flags & XFNM_CASEFOLD)) {
+	wchar_t lc = towlower(c), uc = towupper(c);
+	match = (lc != c && match_bracket_items(b, lc))
+	    || (uc != c && match_bracket_items(b, uc));
+    }
+    return match != b->negated;
+}
+
+/* Tests if character `c' matches any item of bracket expression `b', ignoring
+ * the negation of `b'. */
+bool match_bracket_items(const bracket_T *b, wchar_t c)
+{
+    for (size_t i = 0; i < b->count; i++) {
+	const bracketitem_T *item = &b->items[i];
+	switch (item->type) {
+	    case BR_CHAR:
+		if (c == item->min)
+		    return true;
+		break;
+	    case BR_RANGE:
+		if (item->min <= c && c <= item->max)
+		    return true;
+		break;
+	    case BR_CLASS:
+		if (iswctype(c, item->class))
+		    return true;
+		break;
+	}
+    }
+    return false;
+}
+
+/* Tests if the whole of string `s' matches native pattern `xfnm'. */
+/* Each element other than PE_STAR matches exactly one character, so it
+ * suffices to remember the last star only: when the rest of the pattern fails
+ * to match, we retry by letting the last star match one more character. */
+bool match_native_whole(
+	const xfnmatch_T *restrict xfnm, const wchar_t *restrict s)
+{
+    const patelem_T *elems = xfnm->value.native.elems;
+    size_t count = xfnm->value.native.count;
+    size_t i = 0, stari = (size_t) -1;
+    const wchar_t *stars = NULL;
+
+    while (*s != L'\0') {
+	if (i < count && elems[i].type == PE_STAR) {
+	    stari = ++i;
+	    stars = s;
+	} else if (i < count && match_elem(&elems[i], *s, xfnm->flags)) {
+	    i++;
+	    s++;
+	} else if (stars != NULL) {
+	    i = stari;
+	    s = ++stars;
+	} else {
+	    return false;
+	}
+    }
+    while (i < count && elems[i].type == PE_STAR)
+	i++;
+    return i == count;
+}
+
+/* Returns the length of the longest (or shortest if `shortest' is true) prefix
+ * of string `s' that matches native pattern `xfnm', or (size_t) -1 if no
+ * prefix matches. */
+/* The pattern is simulated as a nondeterministic automaton whose state `i'
+ * means that the first `i' elements of the pattern have been matched. */
+size_t match_native_prefix(
+	const xfnmatch_T *restrict xfnm, const wchar_t *restrict s,
+	bool shortest)
+{
+    const patelem_T *elems = xfnm->value.native.elems;
+    size_t count = xfnm->value.native.count;
+    bool statesbuf[2 * (NATIVE_STATES_ON_STACK + 1)];
+    bool *states = (count <= NATIVE_STATES_ON_STACK)
+	? statesbuf : xmallocn(count + 1, 2 * sizeof *states);
+    bool *nextstates = &states[count + 1];
+    size_t statessize = (count + 1) * sizeof *states;
+    size_t result = (size_t) -1;
+
+    memset(states, 0, statessize);
+    add_state(states, xfnm, 0);
+    for (size_t index = 0; ; index++) {
+	if (states[count]) {
+	    result = index;
+	    if (shortest)
+		break;
+	}
+	if (s[index] == L'\0')
+	    break;
+
+	bool alive = false;
+	memset(nextstates, 0, statessize);
+	for (size_t i = 0; i < count; i++) {
+	    if (!states[i])
+		continue;
+	    if (elems[i].type == PE_STAR)
+		add_state(nextstates, xfnm, i);
+	    else if (match_elem(&elems[i], s[index], xfnm->flags))
+		add_state(nextstates, xfnm, i + 1);
+	    else
+		continue;
+	    alive = true;
+	}
+	if (!alive)
+	    break;
+	memcpy(states, nextstates, statessize);
+    }
+    if (states != statesbuf)
+	free(states);
+    return result;
+}
+
+/* Adds state `i' and the states that are reachable from `i' without consuming
+ * any character to `states'. */
+void add_state(bool *restrict states, const xfnmatch_T *restrict xfnm, size_t i)
+{
+    for (;;) {
+	states[i] = true;
+	if (i >= xfnm->value.native.count
+		|| xfnm->value.native.elems[i].type != PE_STAR)
+	    break;
+	i++;
+    }
+}
+
+/* Finds the longest (or shortest if `shortest' is true) suffix of string `s'
+ * that matches native pattern `xfnm'. */
+xfnmresult_T match_native_tail(
+	const xfnmatch_T *restrict xfnm, const wchar_t *restrict s,
+	bool shortest)
+{
+    size_t length = wcslen(s);
+
+    if (shortest) {
+	size_t i = length;
+	do {
+	    if (match_native_whole(xfnm, &s[i]))
+		return (xfnmresult_T) { .start = i, .end = length };
+	} while (i-- > 0);
+    } else {
+	/* If a pattern that starts with a star does not match the whole string,
+	 * it does not match any suffix either. */
+	size_t n = (xfnm->value.native.count > 0
+		&& xfnm->value.native.elems[0].type == PE_STAR) ? 0 : length;
+	for (size_t i = 0; i <= n; i++)
+	    if (match_native_whole(xfnm, &s[i]))
+		return (xfnmresult_T) { .start = i, .end = length };
+    }
+    return MISMATCH;
+}
+
+/* Finds the leftmost-longest substring of `s' that matches native pattern
+ * `xfnm'. */
+xfnmresult_T match_native_anywhere(
+	const xfnmatch_T *restrict xfnm, const wchar_t *restrict s)
+{
+    const patelem_T *first =
+	(xfnm->value.native.count > 0) ? &xfnm->value.native.elems[0] : NULL;
+
+    for (size_t i = 0; ; i++) {
+	if (first != NULL && first->type == PE_CHAR
+		&& !(xfnm->flags & XFNM_CASEFOLD)) {
+	    /* skip to the next candidate quickly */
+	    const wchar_t *next = wcschr(&s[i], first->value.c);
+	    if (next == NULL)
+		return MISMATCH;
+	    i = next - s;
+	}
+
+	size_t length = match_native_prefix(xfnm, &s[i], false);
+	if (length != (size_t) -1)
+	    return (xfnmresult_T) { .start = i, .end = i + length };
+	if (s[i] == L'\0')
+	    return MISMATCH;
+    }
+}
+
 xfnmresult_T wmatch_headtail(
 	const regex_t *restrict regex, const wchar_t *restrict s)
 {
@@ -698,6 +1253,8 @@ wchar_t *xfnm_subst(const xfnmatch_T *restrict xfnm, const wchar_t *restrict s,
 	xfnmresult_T result;
 	if (flags & XFNM_compiled)
 	    result = wmatch_headtail(&xfnm->value.regex, s);
+	else if (flags & XFNM_native)
+	    result = wmatch_native(xfnm, s);
 	else
 	    result = wmatch_literal(xfnm, s);
 	return xwcsdup((result.start != (size_t) -1) ? repl : s);
@@ -726,6 +1283,8 @@ void xfnm_free(xfnmatch_T *xfnm)
     if (xfnm != NULL) {
 	if (xfnm->flags & XFNM_compiled)
 	    regfree(&xfnm->value.regex);
+	else if (xfnm->flags & XFNM_native)
+	    free_native(xfnm->value.native.count, xfnm->value.native.elems);
 	else
 	    wb_destroy(&xfnm->value.literal);
 	free(xfnm);
@@ -31,6 +31,7 @@ typedef enum {
     XFNM_compiled = 1 << 5,
     XFNM_headstar = 1 << 6,
     XFNM_tailstar = 1 << 7,
+    XFNM_native   = 1 << 8,
 } xfnmflags_T;
 typedef struct {
     size_t start, end;
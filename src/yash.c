@@ -53,7 +53,7 @@
 
 extern int main(int argc, char **argv)
     __attribute__((nonnull));
-static struct input_file_info_T *new_input_file_info(int fd, size_t bufsize)
+static struct input_file_info_T *new_input_file_info(int fd, bool readahead)
     __attribute__((malloc,warn_unused_result));
 static void execute_profile(const wchar_t *profile);
 static void execute_rcfile(const wchar_t *rcfile);
@@ -97,6 +97,7 @@ int main(int argc, char **argv)
 
     setvbuf(stdout, NULL, _IOLBF, BUFSIZ);
     setvbuf(stderr, NULL, _IOLBF, BUFSIZ);
+    atexit(flush_stdout);
 
     setlocale(LC_ALL, "");
 #if HAVE_GETTEXT
@@ -138,7 +139,7 @@ int main(int argc, char **argv)
 
     shell_pid = getpid();
     shell_pgid = getpgrp();
-    stdin_input_file_info = new_input_file_info(STDIN_FILENO, 1);
+    stdin_input_file_info = new_input_file_info(STDIN_FILENO, false);
     init_cmdhash();
     init_homedirhash();
     init_environment();
@@ -245,13 +246,14 @@ int main(int argc, char **argv)
     assert(false);
 }
 
-struct input_file_info_T *new_input_file_info(int fd, size_t bufsize)
+struct input_file_info_T *new_input_file_info(int fd, bool readahead)
 {
     struct input_file_info_T *info
-	= xmallocs(sizeof *info, bufsize, sizeof *info->buf);
+	= xmallocs(sizeof *info, BUFSIZ, sizeof *info->buf);
     info->fd = fd;
     info->bufpos = info->bufmax = 0;
-    info->bufsize = bufsize;
+    info->bufsize = BUFSIZ;
+    info->readahead = readahead;
     memset(&info->state, 0, sizeof info->state);  // initial shift state
     return info;
 }
@@ -487,7 +489,7 @@ void exec_input(int fd, const char *name, exec_input_options_T options)
     if (fd == STDIN_FILENO)
 	inputinfo = stdin_input_file_info;
     else
-	inputinfo = new_input_file_info(fd, BUFSIZ);
+	inputinfo = new_input_file_info(fd, true);
 
     if (pinfo.interactive) {
 	intrinfo.fileinfo = inputinfo;